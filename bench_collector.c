@@ -0,0 +1,285 @@
+/*
+bench_collector: push and gather throughput of the sharded collector
+
+Every thread pushes the same number of elements, either to a shard it
+claimed from an OPENSSL_SK_COLLECTOR or, for comparison, to one shared
+stack behind a mutex.  The shards are then gathered, and merged by a
+second collector whose shards are sorted, into a single stack.  Each thread
+count from 1 to the maximum is run for several rounds and the best round is
+reported:
+
+    bench_collector [-t maxthreads] [-n pushes per thread] [-r rounds]
+
+maxthreads defaults to the number of online CPUs.  The collectors and the
+shared stack are reused across rounds, so after the first round the pushes
+no longer allocate.
+*/
+
+#ifndef _POSIX_C_SOURCE
+# define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "openssl_stack_standalone.h"
+
+#include <time.h>
+
+#ifndef OPENSSL_THREADS
+# error "bench_collector needs thread support, build without OPENSSL_NO_THREADS"
+#endif
+
+#define NKEYS           (1 << 16)
+
+enum bench_mode
+{
+    MODE_MUTEX,
+    MODE_COLLECTOR
+};
+
+typedef struct bench_thread_st
+{
+    pthread_t tid;
+    OPENSSL_STACK* st;          /* claimed shard, or the shared stack */
+    int first;                  /* first key index */
+} BENCH_THREAD;
+
+static long keys[NKEYS];
+static int npush = 1000000;
+static enum bench_mode mode;
+
+/* Start gate, so that thread creation is not timed */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int key_cmp(const void* a, const void* b)
+{
+    long x = **(const long* const*)a;
+    long y = **(const long* const*)b;
+
+    return (x > y) - (x < y);
+}
+
+static void* producer(void* arg)
+{
+    BENCH_THREAD* t = (BENCH_THREAD*)arg;
+    int i;
+
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_open)
+    {
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    }
+    pthread_mutex_unlock(&gate_lock);
+
+    for (i = 0; i < npush; i++)
+    {
+        void* elem = &keys[(t->first + i) & (NKEYS - 1)];
+
+        if (mode == MODE_MUTEX)
+        {
+            pthread_mutex_lock(&shared_lock);
+            OPENSSL_sk_push(t->st, elem);
+            pthread_mutex_unlock(&shared_lock);
+        }
+        else
+        {
+            OPENSSL_sk_push(t->st, elem);
+        }
+    }
+    return NULL;
+}
+
+/*
+* Runs |nthreads| producers, each pushing to its stack in |threads|, and
+* returns the time from opening the gate to the last join, in nanoseconds.
+*/
+static uint64_t run_producers(BENCH_THREAD* threads, int nthreads)
+{
+    uint64_t start;
+    int i;
+
+    gate_open = 0;
+    for (i = 0; i < nthreads; i++)
+    {
+        threads[i].first = i * 7919;
+        if (pthread_create(&threads[i].tid, NULL, producer, &threads[i]) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    pthread_mutex_lock(&gate_lock);
+    start = now();
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+    for (i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i].tid, NULL);
+    }
+    return now() - start;
+}
+
+/* Millions of elements per second */
+static double rate(double n, uint64_t ns)
+{
+    return ns == 0 ? 0 : n * 1e3 / (double)ns;
+}
+
+static void bench(int nthreads, int rounds)
+{
+    OPENSSL_SK_COLLECTOR* col;
+    OPENSSL_SK_COLLECTOR* sorted;
+    OPENSSL_STACK* shared;
+    OPENSSL_STACK* out;
+    BENCH_THREAD* threads;
+    uint64_t t, best_mutex, best_push, best_gather, best_merge;
+    double total = (double)npush * nthreads;
+    int r, i;
+
+    threads = (BENCH_THREAD*)calloc(nthreads, sizeof(*threads));
+    col = OPENSSL_sk_collector_new(key_cmp, nthreads);
+    sorted = OPENSSL_sk_collector_new(key_cmp, nthreads);
+    shared = OPENSSL_sk_new(key_cmp);
+    if (threads == NULL || col == NULL || sorted == NULL || shared == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    best_mutex = best_push = best_gather = best_merge = (uint64_t)-1;
+
+    for (r = 0; r < rounds; r++)
+    {
+        mode = MODE_MUTEX;
+        for (i = 0; i < nthreads; i++)
+        {
+            threads[i].st = shared;
+        }
+        t = run_producers(threads, nthreads);
+        best_mutex = t < best_mutex ? t : best_mutex;
+        OPENSSL_sk_zero(shared);
+
+        mode = MODE_COLLECTOR;
+        for (i = 0; i < nthreads; i++)
+        {
+            threads[i].st = OPENSSL_sk_collector_shard(col, i);
+        }
+        t = run_producers(threads, nthreads);
+        best_push = t < best_push ? t : best_push;
+
+        /* the same shards, sorted, for the merge */
+        for (i = 0; i < nthreads; i++)
+        {
+            OPENSSL_STACK* src = OPENSSL_sk_collector_shard(col, i);
+            int j;
+
+            out = OPENSSL_sk_collector_shard(sorted, i);
+            for (j = 0; j < npush; j++)
+            {
+                if (!OPENSSL_sk_push(out, OPENSSL_sk_value(src, j)))
+                {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+            OPENSSL_sk_sort(out);
+        }
+
+        t = now();
+        out = OPENSSL_sk_collector_gather(col);
+        t = now() - t;
+        if (out == NULL || OPENSSL_sk_num(out) != (int)total)
+        {
+            fprintf(stderr, "gather failed\n");
+            exit(1);
+        }
+        OPENSSL_sk_free(out);
+        best_gather = t < best_gather ? t : best_gather;
+
+        t = now();
+        out = OPENSSL_sk_collector_merge(sorted);
+        t = now() - t;
+        if (out == NULL || OPENSSL_sk_num(out) != (int)total)
+        {
+            fprintf(stderr, "merge failed\n");
+            exit(1);
+        }
+        OPENSSL_sk_free(out);
+        best_merge = t < best_merge ? t : best_merge;
+    }
+
+    printf("%7d %12.1f %12.1f %8.2fx %12.1f %12.1f\n", nthreads,
+           rate(total, best_mutex), rate(total, best_push),
+           (double)best_mutex / (double)best_push,
+           rate(total, best_gather), rate(total, best_merge));
+
+    OPENSSL_sk_free(shared);
+    OPENSSL_sk_collector_free(sorted);
+    OPENSSL_sk_collector_free(col);
+    free(threads);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seed = 2463534242U;
+    int i, maxthreads = 0, rounds = 5;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            maxthreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            npush = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            rounds = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-t maxthreads] [-n pushes per thread] "
+                    "[-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (maxthreads <= 0)
+    {
+        maxthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (maxthreads <= 0 || npush <= 0 || rounds <= 0
+        || npush > INT_MAX / maxthreads)
+    {
+        fprintf(stderr, "bad thread, push or round count\n");
+        return 1;
+    }
+
+    for (i = 0; i < NKEYS; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        keys[i] = (long)(seed & 0x7fffffff);
+    }
+
+    printf("%d pushes per thread, best of %d rounds, millions of elements/s\n\n",
+           npush, rounds);
+    printf("%7s %12s %12s %9s %12s %12s\n", "threads", "mutex push",
+           "shard push", "speedup", "gather", "merge");
+    for (i = 1; i <= maxthreads; i++)
+    {
+        bench(i, rounds);
+    }
+    return 0;
+}
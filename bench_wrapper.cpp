@@ -0,0 +1,218 @@
+/*
+bench_wrapper: ossl::stack<T> against the C API and raw-pointer loops
+
+The same shuffled elements are iterated, sorted and looked up three ways:
+through the C API (sk_value(), sk_sort() with a comparison function
+pointer, sk_find()), through ossl::stack<T> (range-for, sort() and
+std::lower_bound() with an inlined comparator), and with the standard
+algorithms on a plain T** array, which is the baseline the wrapper should
+match.  Each measurement is the best of several rounds:
+
+    bench_wrapper [-n elements] [-r rounds]
+*/
+
+#ifndef _POSIX_C_SOURCE
+# define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "openssl_stack_standalone.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <vector>
+
+typedef struct item_st
+{
+    long key;
+} ITEM;
+
+DEFINE_STACK_OF(ITEM)
+
+static int nelem = 1000000;
+static volatile long sink;
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int item_cmp(const ITEM* const* a, const ITEM* const* b)
+{
+    return ((*a)->key > (*b)->key) - ((*a)->key < (*b)->key);
+}
+
+static bool item_less(const ITEM* a, const ITEM* b)
+{
+    return a->key < b->key;
+}
+
+/* Fills |out| with the elements in the shuffled order of |order| */
+static void load(ITEM** out, ITEM* items, const std::vector<int>& order)
+{
+    for (int i = 0; i < nelem; i++)
+    {
+        out[i] = &items[order[i]];
+    }
+}
+
+static void report(const char* what, uint64_t c, uint64_t wrapper,
+                   uint64_t raw)
+{
+    printf("%-8s %10.2f %10.2f %10.2f %9.2fx\n", what,
+           (double)c / nelem, (double)wrapper / nelem, (double)raw / nelem,
+           (double)wrapper / (double)raw);
+}
+
+static void keep(uint64_t t, uint64_t* best)
+{
+    if (t < *best)
+    {
+        *best = t;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seed = 2463534242U;
+    int i, r, rounds = 5;
+    uint64_t t, best[9];
+    long sum;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            nelem = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            rounds = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n elements] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nelem <= 0 || rounds <= 0)
+    {
+        fprintf(stderr, "bad element or round count\n");
+        return 1;
+    }
+
+    std::vector<ITEM> items(nelem);
+    std::vector<int> order(nelem);
+    std::vector<ITEM*> raw(nelem);
+
+    for (i = 0; i < nelem; i++)
+    {
+        items[i].key = i;
+        order[i] = i;
+    }
+    for (i = nelem - 1; i > 0; i--)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        std::swap(order[i], order[seed % (uint32_t)(i + 1)]);
+    }
+
+    STACK_OF(ITEM) *c = sk_ITEM_new(item_cmp);
+    ossl::stack<ITEM> w(item_cmp);
+
+    w.reserve(nelem);
+    for (i = 0; i < nelem; i++)
+    {
+        sk_ITEM_push(c, &items[order[i]]);
+        w.push_back(&items[order[i]]);
+    }
+
+    for (i = 0; i < 9; i++)
+    {
+        best[i] = (uint64_t)-1;
+    }
+    for (r = 0; r < rounds; r++)
+    {
+        /* iterate: sum of the keys */
+        load(raw.data(), items.data(), order);
+        t = now();
+        for (i = 0, sum = 0; i < sk_ITEM_num(c); i++)
+        {
+            sum += sk_ITEM_value(c, i)->key;
+        }
+        keep(now() - t, &best[0]);
+        sink = sum;
+        t = now();
+        sum = 0;
+        for (ITEM* p : w)
+        {
+            sum += p->key;
+        }
+        keep(now() - t, &best[1]);
+        sink = sum;
+        t = now();
+        for (i = 0, sum = 0; i < nelem; i++)
+        {
+            sum += raw[i]->key;
+        }
+        keep(now() - t, &best[2]);
+        sink = sum;
+
+        /* sort from the same shuffled order */
+        for (i = 0; i < nelem; i++)
+        {
+            sk_ITEM_set(c, i, &items[order[i]]);
+        }
+        t = now();
+        sk_ITEM_sort(c);
+        keep(now() - t, &best[3]);
+        load(w.begin(), items.data(), order);
+        t = now();
+        w.sort(item_less, true);
+        keep(now() - t, &best[4]);
+        t = now();
+        std::sort(raw.begin(), raw.end(), item_less);
+        keep(now() - t, &best[5]);
+
+        /* find every element, in the shuffled order */
+        t = now();
+        for (i = 0, sum = 0; i < nelem; i++)
+        {
+            sum += sk_ITEM_find(c, &items[order[i]]);
+        }
+        keep(now() - t, &best[6]);
+        sink = sum;
+        t = now();
+        for (i = 0, sum = 0; i < nelem; i++)
+        {
+            sum += std::lower_bound(w.begin(), w.end(), &items[order[i]],
+                                    item_less) - w.begin();
+        }
+        keep(now() - t, &best[7]);
+        sink = sum;
+        t = now();
+        for (i = 0, sum = 0; i < nelem; i++)
+        {
+            sum += std::lower_bound(raw.begin(), raw.end(), &items[order[i]],
+                                    item_less) - raw.begin();
+        }
+        keep(now() - t, &best[8]);
+        sink = sum;
+    }
+
+    printf("%d elements, best of %d rounds, ns per element\n\n", nelem,
+           rounds);
+    printf("%-8s %10s %10s %10s %10s\n", "", "C API", "wrapper", "raw",
+           "wrap/raw");
+    report("iterate", best[0], best[1], best[2]);
+    report("sort", best[3], best[4], best[5]);
+    report("find", best[6], best[7], best[8]);
+
+    sk_ITEM_free(c);
+    return 0;
+}
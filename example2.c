@@ -0,0 +1,87 @@
+#include "openssl_stack_standalone.h"
+
+/*
+* sk_uniq() with the same object pushed more than once: each dropped object
+* is freed exactly once and the kept ones are never freed.
+*/
+typedef struct example_st
+{
+    int key;
+    int freed;
+} example_t;
+
+DEFINE_STACK_OF(example_t);
+
+static int example_cmp(const example_t* const* x, const example_t* const* y)
+{
+    return (*x)->key - (*y)->key;
+}
+
+static void example_free(example_t* e)
+{
+    e->freed++;
+}
+
+static int check(const char* name, STACK_OF(example_t) *st, example_t* e,
+                 int n, int kept)
+{
+    int i, ok = 1;
+
+    /* the kept object is never freed, the others once */
+    for (i = 0; i < n; i++)
+    {
+        if (e[i].freed != (i == kept ? 0 : 1))
+        {
+            ok = 0;
+        }
+    }
+    if (sk_example_t_num(st) != 1 || sk_example_t_value(st, 0) != &e[kept])
+    {
+        ok = 0;
+    }
+    printf("\n %s: %s \n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(void)
+{
+    STACK_OF(example_t) *st;
+    example_t e[2];
+    int i, ok = 1;
+
+    /* [a, b, b], all equal, first kept: b freed once */
+    memset(e, 0, sizeof(e));
+    st = sk_example_t_new(example_cmp);
+    sk_example_t_set_stable(st, 1);
+    sk_example_t_push(st, &e[0]);
+    sk_example_t_push(st, &e[1]);
+    sk_example_t_push(st, &e[1]);
+    sk_example_t_uniq(st, example_free);
+    ok &= check("uniq [a, b, b]", st, e, 2, 0);
+    sk_example_t_free(st);
+
+    /* [b, a, b], all equal, last kept: b kept, a freed, b never freed */
+    memset(e, 0, sizeof(e));
+    st = sk_example_t_new(example_cmp);
+    sk_example_t_set_stable(st, 1);
+    sk_example_t_push(st, &e[1]);
+    sk_example_t_push(st, &e[0]);
+    sk_example_t_push(st, &e[1]);
+    sk_example_t_uniq_last(st, example_free);
+    ok &= check("uniq_last [b, a, b]", st, e, 2, 1);
+    sk_example_t_free(st);
+
+    /* a long run, [a, b, a, b, ...], first kept: b freed once */
+    memset(e, 0, sizeof(e));
+    st = sk_example_t_new(example_cmp);
+    sk_example_t_set_stable(st, 1);
+    for (i = 0; i < 40; i++)
+    {
+        sk_example_t_push(st, &e[i % 2]);
+    }
+    sk_example_t_uniq(st, example_free);
+    ok &= check("uniq [a, b, a, b, ...]", st, e, 2, 0);
+    sk_example_t_free(st);
+
+    return ok ? 0 : 1;
+}
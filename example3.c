@@ -0,0 +1,62 @@
+#include "openssl_stack_standalone.h"
+
+/*
+* Finds on a keyed stack after deletes: the stack stays sorted but its
+* search index is stale, and the finds must binary search instead of
+* rebuilding the index, which would cost a key call per element each time.
+*/
+typedef struct example_st
+{
+    int key;
+} example_t;
+
+DEFINE_STACK_OF(example_t);
+
+static unsigned long key_calls;
+
+static int example_cmp(const example_t* const* x, const example_t* const* y)
+{
+    return (*x)->key - (*y)->key;
+}
+
+static uint64_t example_key(const example_t* e)
+{
+    key_calls++;
+    return (uint64_t)e->key;
+}
+
+int main(void)
+{
+    STACK_OF(example_t) *st;
+    example_t e[4096];
+    int i, n = 4096, ok = 1;
+
+    st = sk_example_t_new(example_cmp);
+    for (i = 0; i < n; i++)
+    {
+        e[i].key = i * 2;
+        sk_example_t_push(st, &e[i]);
+    }
+    sk_example_t_set_key_func(st, example_key);
+    sk_example_t_sort(st);
+
+    /* find, then delete what was found: O(log n) each, no rebuild */
+    key_calls = 0;
+    for (i = 0; i < n / 2; i++)
+    {
+        if (sk_example_t_find(st, &e[i]) != 0)
+        {
+            ok = 0;
+        }
+        sk_example_t_delete(st, 0);
+    }
+    if (key_calls > (unsigned long)n)
+    {
+        ok = 0;
+    }
+    printf("\n find after delete: %s (%lu key calls) \n", ok ? "ok" : "FAILED",
+           key_calls);
+
+    sk_example_t_free(st);
+    return ok ? 0 : 1;
+}
@@ -1,17 +1,17 @@
 /*
-Standalone and Self-sufficient header in C for openssl stack use
-
-STACK API
-The stack library provides a generic way to handle collections of objects in OpenSSL.
-A comparison function can be registered to sort the collection.
-
-https://wiki.openssl.org/index.php/STACK_API
-
-https://github.com/David-Reguera-Garcia-Dreg/openssl_stack_standalone
-
-Contact: http://www.fr33project.org/ - dreg@fr33project.org - David Reguera Garcia aka Dreg
-*/
-
+Standalone and Self-sufficient header in C for openssl stack use
+
+STACK API
+The stack library provides a generic way to handle collections of objects in OpenSSL.
+A comparison function can be registered to sort the collection.
+
+https://wiki.openssl.org/index.php/STACK_API
+
+https://github.com/David-Reguera-Garcia-Dreg/openssl_stack_standalone
+
+Contact: http://www.fr33project.org/ - dreg@fr33project.org - David Reguera Garcia aka Dreg
+*/
+
 /*
 * Copyright 1995-2018 The OpenSSL Project Authors. All Rights Reserved.
 *
@@ -30,6 +30,7 @@ Contact: http://www.fr33project.org/ - dreg@fr33project.org - David Reguera Garc
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
 
 #ifndef HEADER_OBJECTS_H
 # define HEADER_OBJECTS_H
@@ -59,11 +60,25 @@ typedef struct obj_name_st
     const char* data;
 } OBJ_NAME;
 
+const void* OBJ_bsearch_(const void* key, const void* base, int num,
+                         int size, int(*cmp) (const void*, const void*));
 const void* OBJ_bsearch_ex_(const void* key, const void* base, int num,
                             int size,
                             int(*cmp) (const void*, const void*),
                             int flags);
 
+int OBJ_NAME_init(void);
+const char* OBJ_NAME_get(const char* name, int type);
+int OBJ_NAME_add(const char* name, int type, const char* data);
+int OBJ_NAME_remove(const char* name, int type);
+void OBJ_NAME_cleanup(int type); /* -1 for everything */
+void OBJ_NAME_do_all(int type, void (*fn)(const OBJ_NAME*, void* arg),
+                     void* arg);
+void OBJ_NAME_do_all_sorted(int type,
+                            void (*fn)(const OBJ_NAME*, void* arg),
+                            void* arg);
+int OBJ_NAME_freeze(void);
+
 # define _DECLARE_OBJ_BSEARCH_CMP_FN(scope, type1, type2, nm)    \
   static int nm##_cmp_BSEARCH_CMP_FN(const void *, const void *); \
   static int nm##_cmp(type1 const *, type2 const *); \
@@ -129,6 +144,53 @@ const void* OBJ_bsearch_ex_(const void* key, const void* base, int num,
       } \
       extern void dummy_prototype(void)
 
+/*-
+* Same searches as IMPLEMENT_OBJ_BSEARCH_CMP_FN, but generated per type as
+* static inline functions that call nm##_cmp directly, with no void* wrapper
+* or function pointer in between, so the comparison and sizeof(type2) are
+* visible to the compiler.  nm##_cmp must be defined before the macro:
+*
+*   static int nid_cmp(const int *a, const NID_ENTRY *b) { ... }
+*   IMPLEMENT_OBJ_BSEARCH_INLINE_CMP_FN(int, NID_ENTRY, nid);
+*
+* defines OBJ_bsearch_nid(key, base, num) and OBJ_bsearch_ex_nid(key, base,
+* num, flags), the latter taking the OBJ_BSEARCH_* flags of OBJ_bsearch_ex_().
+*/
+# define IMPLEMENT_OBJ_BSEARCH_INLINE_CMP_FN(type1, type2, nm)   \
+  static ossl_inline type2 *OBJ_bsearch_ex_##nm(type1 *key, type2 const *base, \
+                                                int num, int flags) \
+      { \
+      type2 const *p = NULL; \
+      int l = 0, h = num, i = 0, c = 0; \
+      if (num <= 0) \
+          return NULL; \
+      while (l < h) { \
+          i = (l + h) / 2; \
+          p = &base[i]; \
+          c = nm##_cmp(key, p); \
+          if (c < 0) \
+              h = i; \
+          else if (c > 0) \
+              l = i + 1; \
+          else \
+              break; \
+      } \
+      if (c != 0 && !(flags & OBJ_BSEARCH_VALUE_ON_NOMATCH)) \
+          p = NULL; \
+      else if (c == 0 && (flags & OBJ_BSEARCH_FIRST_VALUE_ON_MATCH)) { \
+          while (i > 0 && nm##_cmp(key, &base[i - 1]) == 0) \
+              i--; \
+          p = &base[i]; \
+      } \
+      return (type2 *)p; \
+      } \
+  static ossl_inline type2 *OBJ_bsearch_##nm(type1 *key, type2 const *base, \
+                                             int num) \
+      { \
+      return OBJ_bsearch_ex_##nm(key, base, num, 0); \
+      } \
+      extern void dummy_prototype(void)
+
 # define OBJ_bsearch(type1,key,type2,base,num,cmp)                              \
   ((type2 *)OBJ_bsearch_(CHECKED_PTR_OF(type1,key),CHECKED_PTR_OF(type2,base), \
                          num,sizeof(type2),                             \
@@ -154,12 +216,18 @@ const void* OBJ_bsearch_ex_(const void* key, const void* base, int num,
 
 
 
+const void* OBJ_bsearch_(const void* key, const void* base, int num,
+                         int size, int(*cmp) (const void*, const void*))
+{
+    return OBJ_bsearch_ex_(key, base, num, size, cmp, 0);
+}
+
 const void* OBJ_bsearch_ex_(const void* key, const void* base_, int num,
                             int size,
                             int(*cmp) (const void*, const void*),
                             int flags)
 {
-    const char* base = base_;
+    const char* base = (const char*)base_;
     int l, h, i = 0, c = 0;
     const char* p = NULL;
 
@@ -500,6 +568,18 @@ typedef unsigned __int64 uint64_t;
 #  define ossl_noreturn
 # endif
 
+/*
+* Thread support is used by the parallel helpers, which fall back to running
+* in the calling thread without it, by the OBJ_NAME registry and RCU stack
+* locks and to give each thread its own stack pool.  It is on by default on
+* Unix with GCC or Clang, so programs link with -lpthread; define
+* OPENSSL_NO_THREADS to build without pthreads, for single-threaded programs.
+*/
+# if !defined(OPENSSL_NO_THREADS) && !defined(OPENSSL_THREADS) && \
+     defined(OPENSSL_SYS_UNIX) && defined(__GNUC__)
+#  define OPENSSL_THREADS
+# endif
+
 #ifdef  __cplusplus
 }
 #endif
@@ -517,6 +597,8 @@ typedef struct stack_st OPENSSL_STACK; /* Use STACK_OF(...) instead */
 typedef int(*OPENSSL_sk_compfunc)(const void*, const void*);
 typedef void(*OPENSSL_sk_freefunc)(void*);
 typedef void* (*OPENSSL_sk_copyfunc)(const void*);
+typedef int(*OPENSSL_sk_foreachfunc)(void*, void*);
+typedef uint64_t(*OPENSSL_sk_keyfunc)(const void*);
 
 int OPENSSL_sk_num(const OPENSSL_STACK*);
 void* OPENSSL_sk_value(const OPENSSL_STACK*, int);
@@ -535,18 +617,241 @@ OPENSSL_STACK* OPENSSL_sk_deep_copy(const OPENSSL_STACK*,
 int OPENSSL_sk_insert(OPENSSL_STACK* sk, const void* data, int where);
 void* OPENSSL_sk_delete(OPENSSL_STACK* st, int loc);
 void* OPENSSL_sk_delete_ptr(OPENSSL_STACK* st, const void* p);
+int OPENSSL_sk_concat(OPENSSL_STACK* dst, OPENSSL_STACK* src);
+int OPENSSL_sk_splice(OPENSSL_STACK* dst, int where, OPENSSL_STACK* src,
+                      int from, int count);
+int OPENSSL_sk_swap(OPENSSL_STACK* a, OPENSSL_STACK* b);
+void** OPENSSL_sk_steal_array(OPENSSL_STACK* st, int* num);
+OPENSSL_STACK* OPENSSL_sk_from_array(OPENSSL_sk_compfunc c, void** data,
+                                     int num, int num_alloc);
 int OPENSSL_sk_find(OPENSSL_STACK* st, const void* data);
 int OPENSSL_sk_find_ex(OPENSSL_STACK* st, const void* data);
+int OPENSSL_sk_lower_bound(OPENSSL_STACK* st, const void* data);
+int OPENSSL_sk_upper_bound(OPENSSL_STACK* st, const void* data);
+int OPENSSL_sk_equal_range(OPENSSL_STACK* st, const void* data,
+                           int* first, int* last);
+int OPENSSL_sk_count(OPENSSL_STACK* st, const void* data);
+int OPENSSL_sk_find_many(OPENSSL_STACK* st, const void* const* keys,
+                         int nkeys, int* out_idx);
+OPENSSL_STACK* OPENSSL_sk_merge(OPENSSL_STACK* a, OPENSSL_STACK* b);
+OPENSSL_STACK* OPENSSL_sk_set_union(OPENSSL_STACK* a, OPENSSL_STACK* b);
+OPENSSL_STACK* OPENSSL_sk_set_intersection(OPENSSL_STACK* a,
+        OPENSSL_STACK* b);
+OPENSSL_STACK* OPENSSL_sk_set_difference(OPENSSL_STACK* a, OPENSSL_STACK* b);
+int OPENSSL_sk_set_union_into(OPENSSL_STACK* dst, OPENSSL_STACK* src);
 int OPENSSL_sk_push(OPENSSL_STACK* st, const void* data);
 int OPENSSL_sk_unshift(OPENSSL_STACK* st, const void* data);
 void* OPENSSL_sk_shift(OPENSSL_STACK* st);
 void* OPENSSL_sk_pop(OPENSSL_STACK* st);
 void OPENSSL_sk_zero(OPENSSL_STACK* st);
+void OPENSSL_sk_clear(OPENSSL_STACK* st);
 OPENSSL_sk_compfunc OPENSSL_sk_set_cmp_func(OPENSSL_STACK* sk,
         OPENSSL_sk_compfunc cmp);
 OPENSSL_STACK* OPENSSL_sk_dup(const OPENSSL_STACK* st);
+OPENSSL_STACK* OPENSSL_sk_view(const OPENSSL_STACK* st, int start, int len);
+int OPENSSL_sk_is_view(const OPENSSL_STACK* st);
 void OPENSSL_sk_sort(OPENSSL_STACK* st);
 int OPENSSL_sk_is_sorted(const OPENSSL_STACK* st);
+void OPENSSL_sk_stable_sort(OPENSSL_STACK* st);
+int OPENSSL_sk_set_stable(OPENSSL_STACK* st, int stable);
+int OPENSSL_sk_set_chunked(OPENSSL_STACK* st, int chunked);
+int OPENSSL_sk_radix_sort(OPENSSL_STACK* st, OPENSSL_sk_keyfunc key,
+                          int key_bits);
+OPENSSL_sk_keyfunc OPENSSL_sk_set_key_func(OPENSSL_STACK* st,
+        OPENSSL_sk_keyfunc key);
+int OPENSSL_sk_build_index(OPENSSL_STACK* st);
+int OPENSSL_sk_nth_element(OPENSSL_STACK* st, int nth);
+int OPENSSL_sk_partial_sort(OPENSSL_STACK* st, int k);
+int OPENSSL_sk_top_k(const OPENSSL_STACK* st, int k, OPENSSL_STACK* out);
+int OPENSSL_sk_set_heap_arity(OPENSSL_STACK* st, int arity);
+int OPENSSL_sk_heapify(OPENSSL_STACK* st);
+int OPENSSL_sk_heap_push(OPENSSL_STACK* st, const void* data);
+void* OPENSSL_sk_heap_pop(OPENSSL_STACK* st);
+void* OPENSSL_sk_heap_top(const OPENSSL_STACK* st);
+int OPENSSL_sk_heap_update(OPENSSL_STACK* st, int idx);
+void* OPENSSL_sk_heap_delete(OPENSSL_STACK* st, int idx);
+int OPENSSL_sk_uniq(OPENSSL_STACK* st, OPENSSL_sk_freefunc func);
+int OPENSSL_sk_uniq_last(OPENSSL_STACK* st, OPENSSL_sk_freefunc func);
+int OPENSSL_sk_foreach(const OPENSSL_STACK* st, OPENSSL_sk_foreachfunc fn,
+                       void* arg);
+int OPENSSL_sk_foreach_parallel(const OPENSSL_STACK* st,
+                                OPENSSL_sk_foreachfunc fn, void* arg,
+                                int nthreads);
+
+/*
+* Sharded collector: each producer thread claims a shard, an ordinary stack
+* on its own cache lines that it pushes to without any locking, and once the
+* producers are done the shards are gathered (or merged, when sorted) into a
+* single stack.  Shards live inside the collector's own allocation and are
+* released by OPENSSL_sk_collector_free() only: never pass one to
+* OPENSSL_sk_free(), OPENSSL_sk_pop_free() or anything that frees the stack,
+* such as an owning C++ ossl::stack (debug builds assert on it).
+*/
+typedef struct sk_collector_st OPENSSL_SK_COLLECTOR;
+
+OPENSSL_SK_COLLECTOR* OPENSSL_sk_collector_new(OPENSSL_sk_compfunc c,
+        int nshards);
+void OPENSSL_sk_collector_free(OPENSSL_SK_COLLECTOR* col);
+int OPENSSL_sk_collector_num_shards(const OPENSSL_SK_COLLECTOR* col);
+OPENSSL_STACK* OPENSSL_sk_collector_shard(OPENSSL_SK_COLLECTOR* col, int i);
+OPENSSL_STACK* OPENSSL_sk_collector_claim(OPENSSL_SK_COLLECTOR* col);
+OPENSSL_STACK* OPENSSL_sk_collector_gather(OPENSSL_SK_COLLECTOR* col);
+OPENSSL_STACK* OPENSSL_sk_collector_merge(OPENSSL_SK_COLLECTOR* col);
+
+/*
+* Read-copy-update stack for read-mostly tables.  Readers get the current
+* snapshot, an immutable stack, without locks or waiting; a writer edits a
+* private copy and publishes it atomically, and old snapshots are freed once
+* no reader can still see them (epoch-based reclamation).
+*
+* Each reader thread registers an OPENSSL_SK_RCU_READER of its own and
+* brackets its accesses with OPENSSL_sk_rcu_read_lock()/read_unlock(); the
+* snapshot must not be used after the unlock, nor modified.  Snapshots are
+* published sorted, with their search index built, and are searched with
+* OPENSSL_sk_rcu_find(), which unlike OPENSSL_sk_find() takes a const stack.
+*/
+typedef struct sk_rcu_st OPENSSL_SK_RCU;
+typedef struct sk_rcu_reader_st OPENSSL_SK_RCU_READER;
+
+OPENSSL_SK_RCU* OPENSSL_sk_rcu_new(OPENSSL_STACK* st);
+void OPENSSL_sk_rcu_free(OPENSSL_SK_RCU* rcu, OPENSSL_sk_freefunc func);
+OPENSSL_SK_RCU_READER* OPENSSL_sk_rcu_reader_new(OPENSSL_SK_RCU* rcu);
+void OPENSSL_sk_rcu_reader_free(OPENSSL_SK_RCU_READER* rd);
+const OPENSSL_STACK* OPENSSL_sk_rcu_read_lock(OPENSSL_SK_RCU_READER* rd);
+void OPENSSL_sk_rcu_read_unlock(OPENSSL_SK_RCU_READER* rd);
+int OPENSSL_sk_rcu_find(const OPENSSL_STACK* snap, const void* data);
+OPENSSL_STACK* OPENSSL_sk_rcu_write_begin(OPENSSL_SK_RCU* rcu);
+int OPENSSL_sk_rcu_write_commit(OPENSSL_SK_RCU* rcu, OPENSSL_STACK* next);
+void OPENSSL_sk_rcu_write_abort(OPENSSL_SK_RCU* rcu, OPENSSL_STACK* next);
+int OPENSSL_sk_rcu_reclaim(OPENSSL_SK_RCU* rcu);
+
+/*
+* Each thread keeps a few freed stack headers and small data buffers for
+* reuse by the next stacks it creates, unless built with OPENSSL_NO_SK_POOL.
+* The statistics and the flush cover the calling thread's pool only.  A
+* thread's pool is emptied when it exits, and the pool of the thread that
+* calls exit(), normally the main thread, by an atexit() handler; stacks
+* freed by atexit() handlers that run after it may still be left cached.
+*/
+typedef struct openssl_sk_pool_stats_st
+{
+    size_t header_hits;         /* headers taken from the pool */
+    size_t header_misses;       /* headers allocated */
+    size_t buffer_hits;         /* data buffers taken from the pool */
+    size_t buffer_misses;       /* data buffers allocated */
+    size_t headers_cached;      /* currently in the pool */
+    size_t buffers_cached;
+    size_t bytes_cached;
+} OPENSSL_SK_POOL_STATS;
+
+void OPENSSL_sk_pool_stats(OPENSSL_SK_POOL_STATS* stats);
+void OPENSSL_sk_pool_flush(void);
+
+/*
+* Operation trace, built in with OPENSSL_SK_TRACE: a binary log of the
+* calls made on stacks, for replaying a workload with sk_replay.c.  The log
+* is OPENSSL_SK_TRACE_MAGIC followed by OPENSSL_SK_TRACE_REC records in host
+* byte order.  Stacks are numbered in the order they are first seen and the
+* elements are never written, only the index and size an operation
+* involves.  Tracing starts with OPENSSL_sk_trace_start() or, when the
+* OPENSSL_SK_TRACE_FILE environment variable names a file, with the first
+* traced call.  Without OPENSSL_SK_TRACE, OPENSSL_sk_trace_start() fails.
+*/
+# define OPENSSL_SK_TRACE_MAGIC          "SKTRACE1"
+# define OPENSSL_SK_TRACE_MAGIC_LEN      8
+
+# define OPENSSL_SK_OP_NEW               1   /* |index|: reserved size */
+# define OPENSSL_SK_OP_FREE              2
+# define OPENSSL_SK_OP_DUP               3   /* |index|: source stack id */
+# define OPENSSL_SK_OP_RESERVE           4   /* |index|: reserved size */
+# define OPENSSL_SK_OP_INSERT            5   /* push and unshift included */
+# define OPENSSL_SK_OP_DELETE            6   /* pop and shift included */
+# define OPENSSL_SK_OP_VALUE             7
+# define OPENSSL_SK_OP_SET               8
+# define OPENSSL_SK_OP_FIND              9   /* |index|: result */
+# define OPENSSL_SK_OP_FIND_EX           10  /* |index|: result */
+# define OPENSSL_SK_OP_SORT              11
+# define OPENSSL_SK_OP_ZERO              12
+# define OPENSSL_SK_OP_NUM               13
+# define OPENSSL_SK_OP_MAX               13
+
+# define OPENSSL_SK_TRACE_CMP            0x01  /* has a comparison function */
+
+typedef struct openssl_sk_trace_rec_st
+{
+    uint64_t time;              /* nanoseconds since the trace started */
+    uint32_t stack;             /* stack id, from 1 */
+    uint8_t op;
+    uint8_t flags;
+    uint16_t reserved;
+    int32_t index;
+    int32_t num;                /* size of the stack before the operation */
+} OPENSSL_SK_TRACE_REC;
+
+int OPENSSL_sk_trace_start(const char* path);
+void OPENSSL_sk_trace_stop(void);
+
+/*
+* Prefetching iteration: |distance| is how many elements ahead to prefetch
+* (OPENSSL_SK_PREFETCH_AUTO picks one from the stack size, a negative value
+* disables prefetching) and |offset| is the byte offset of the field to
+* prefetch in each element, or OPENSSL_SK_PREFETCH_NOFIELD for its start.
+*/
+# define OPENSSL_SK_PREFETCH_AUTO        0
+# define OPENSSL_SK_PREFETCH_NOFIELD     (-1)
+
+typedef struct openssl_sk_iter_st
+{
+    const OPENSSL_STACK* st;
+    const void** data;          /* NULL to read |st| with sk_value() */
+    int num;
+    int i;
+    int distance;
+    int offset;
+} OPENSSL_SK_ITER;
+
+void OPENSSL_sk_iter_init(OPENSSL_SK_ITER* it, const OPENSSL_STACK* st,
+                          int distance, int offset);
+int OPENSSL_sk_foreach_prefetch(const OPENSSL_STACK* st,
+                                OPENSSL_sk_foreachfunc fn, void* arg,
+                                int distance, int offset);
+
+# if defined(__GNUC__)
+#  define ossl_prefetch(addr) __builtin_prefetch((addr), 0, 3)
+# else
+#  define ossl_prefetch(addr) ((void)(addr))
+# endif
+
+static ossl_inline void sk_prefetch_elem(const void* elem, int offset)
+{
+    if (elem != NULL)
+    {
+        ossl_prefetch((const char*)elem + (offset < 0 ? 0 : offset));
+    }
+}
+
+/*
+* Stores the next element in |*out| and returns 1, or returns 0 once the
+* stack is exhausted.  The stack must not be modified while iterating.
+*/
+static ossl_inline int OPENSSL_sk_iter_next(OPENSSL_SK_ITER* it, void** out)
+{
+    if (it->i >= it->num)
+    {
+        return 0;
+    }
+    if (it->data == NULL)
+    {
+        *out = OPENSSL_sk_value(it->st, it->i++);
+        return 1;
+    }
+    if (it->distance > 0 && it->i + it->distance < it->num)
+    {
+        sk_prefetch_elem(it->data[it->i + it->distance], it->offset);
+    }
+    *out = (void*)it->data[it->i++];
+    return 1;
+}
 
 # if OPENSSL_API_COMPAT < 0x10100000L
 #  define _STACK OPENSSL_STACK
@@ -561,6 +866,8 @@ int OPENSSL_sk_is_sorted(const OPENSSL_STACK* st);
 #  define sk_insert OPENSSL_sk_insert
 #  define sk_delete OPENSSL_sk_delete
 #  define sk_delete_ptr OPENSSL_sk_delete_ptr
+#  define sk_concat OPENSSL_sk_concat
+#  define sk_splice OPENSSL_sk_splice
 #  define sk_find OPENSSL_sk_find
 #  define sk_find_ex OPENSSL_sk_find_ex
 #  define sk_push OPENSSL_sk_push
@@ -568,8 +875,10 @@ int OPENSSL_sk_is_sorted(const OPENSSL_STACK* st);
 #  define sk_shift OPENSSL_sk_shift
 #  define sk_pop OPENSSL_sk_pop
 #  define sk_zero OPENSSL_sk_zero
+#  define sk_clear OPENSSL_sk_clear
 #  define sk_set_cmp_func OPENSSL_sk_set_cmp_func
 #  define sk_dup OPENSSL_sk_dup
+#  define sk_view OPENSSL_sk_view
 #  define sk_sort OPENSSL_sk_sort
 #  define sk_is_sorted OPENSSL_sk_is_sorted
 # endif
@@ -594,6 +903,8 @@ extern "C" {
     typedef int (*sk_##t1##_compfunc)(const t3 * const *a, const t3 *const *b); \
     typedef void (*sk_##t1##_freefunc)(t3 *a); \
     typedef t3 * (*sk_##t1##_copyfunc)(const t3 *a); \
+    typedef int (*sk_##t1##_foreachfunc)(t2 *a, void *arg); \
+    typedef uint64_t (*sk_##t1##_keyfunc)(const t3 *a); \
     static ossl_inline int sk_##t1##_num(const STACK_OF(t1) *sk) \
     { \
         return OPENSSL_sk_num((const OPENSSL_STACK *)sk); \
@@ -626,6 +937,10 @@ extern "C" {
     { \
         OPENSSL_sk_zero((OPENSSL_STACK *)sk); \
     } \
+    static ossl_inline void sk_##t1##_clear(STACK_OF(t1) *sk) \
+    { \
+        OPENSSL_sk_clear((OPENSSL_STACK *)sk); \
+    } \
     static ossl_inline t2 *sk_##t1##_delete(STACK_OF(t1) *sk, int i) \
     { \
         return (t2 *)OPENSSL_sk_delete((OPENSSL_STACK *)sk, i); \
@@ -635,6 +950,26 @@ extern "C" {
         return (t2 *)OPENSSL_sk_delete_ptr((OPENSSL_STACK *)sk, \
                                            (const void *)ptr); \
     } \
+    static ossl_inline int sk_##t1##_concat(STACK_OF(t1) *dst, STACK_OF(t1) *src) \
+    { \
+        return OPENSSL_sk_concat((OPENSSL_STACK *)dst, (OPENSSL_STACK *)src); \
+    } \
+    static ossl_inline int sk_##t1##_splice(STACK_OF(t1) *dst, int where, STACK_OF(t1) *src, int from, int count) \
+    { \
+        return OPENSSL_sk_splice((OPENSSL_STACK *)dst, where, (OPENSSL_STACK *)src, from, count); \
+    } \
+    static ossl_inline int sk_##t1##_swap(STACK_OF(t1) *a, STACK_OF(t1) *b) \
+    { \
+        return OPENSSL_sk_swap((OPENSSL_STACK *)a, (OPENSSL_STACK *)b); \
+    } \
+    static ossl_inline t2 **sk_##t1##_steal_array(STACK_OF(t1) *sk, int *num) \
+    { \
+        return (t2 **)OPENSSL_sk_steal_array((OPENSSL_STACK *)sk, num); \
+    } \
+    static ossl_inline STACK_OF(t1) *sk_##t1##_from_array(sk_##t1##_compfunc compare, t2 **data, int num, int num_alloc) \
+    { \
+        return (STACK_OF(t1) *)OPENSSL_sk_from_array((OPENSSL_sk_compfunc)compare, (void **)data, num, num_alloc); \
+    } \
     static ossl_inline int sk_##t1##_push(STACK_OF(t1) *sk, t2 *ptr) \
     { \
         return OPENSSL_sk_push((OPENSSL_STACK *)sk, (const void *)ptr); \
@@ -671,6 +1006,46 @@ extern "C" {
     { \
         return OPENSSL_sk_find_ex((OPENSSL_STACK *)sk, (const void *)ptr); \
     } \
+    static ossl_inline int sk_##t1##_lower_bound(STACK_OF(t1) *sk, t2 *ptr) \
+    { \
+        return OPENSSL_sk_lower_bound((OPENSSL_STACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline int sk_##t1##_upper_bound(STACK_OF(t1) *sk, t2 *ptr) \
+    { \
+        return OPENSSL_sk_upper_bound((OPENSSL_STACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline int sk_##t1##_equal_range(STACK_OF(t1) *sk, t2 *ptr, int *first, int *last) \
+    { \
+        return OPENSSL_sk_equal_range((OPENSSL_STACK *)sk, (const void *)ptr, first, last); \
+    } \
+    static ossl_inline int sk_##t1##_count(STACK_OF(t1) *sk, t2 *ptr) \
+    { \
+        return OPENSSL_sk_count((OPENSSL_STACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline int sk_##t1##_find_many(STACK_OF(t1) *sk, t2 *const *keys, int nkeys, int *out_idx) \
+    { \
+        return OPENSSL_sk_find_many((OPENSSL_STACK *)sk, (const void *const *)keys, nkeys, out_idx); \
+    } \
+    static ossl_inline STACK_OF(t1) *sk_##t1##_merge(STACK_OF(t1) *a, STACK_OF(t1) *b) \
+    { \
+        return (STACK_OF(t1) *)OPENSSL_sk_merge((OPENSSL_STACK *)a, (OPENSSL_STACK *)b); \
+    } \
+    static ossl_inline STACK_OF(t1) *sk_##t1##_set_union(STACK_OF(t1) *a, STACK_OF(t1) *b) \
+    { \
+        return (STACK_OF(t1) *)OPENSSL_sk_set_union((OPENSSL_STACK *)a, (OPENSSL_STACK *)b); \
+    } \
+    static ossl_inline STACK_OF(t1) *sk_##t1##_set_intersection(STACK_OF(t1) *a, STACK_OF(t1) *b) \
+    { \
+        return (STACK_OF(t1) *)OPENSSL_sk_set_intersection((OPENSSL_STACK *)a, (OPENSSL_STACK *)b); \
+    } \
+    static ossl_inline STACK_OF(t1) *sk_##t1##_set_difference(STACK_OF(t1) *a, STACK_OF(t1) *b) \
+    { \
+        return (STACK_OF(t1) *)OPENSSL_sk_set_difference((OPENSSL_STACK *)a, (OPENSSL_STACK *)b); \
+    } \
+    static ossl_inline int sk_##t1##_set_union_into(STACK_OF(t1) *dst, STACK_OF(t1) *src) \
+    { \
+        return OPENSSL_sk_set_union_into((OPENSSL_STACK *)dst, (OPENSSL_STACK *)src); \
+    } \
     static ossl_inline void sk_##t1##_sort(STACK_OF(t1) *sk) \
     { \
         OPENSSL_sk_sort((OPENSSL_STACK *)sk); \
@@ -683,6 +1058,14 @@ extern "C" {
     { \
         return (STACK_OF(t1) *)OPENSSL_sk_dup((const OPENSSL_STACK *)sk); \
     } \
+    static ossl_inline STACK_OF(t1) *sk_##t1##_view(const STACK_OF(t1) *sk, int start, int len) \
+    { \
+        return (STACK_OF(t1) *)OPENSSL_sk_view((const OPENSSL_STACK *)sk, start, len); \
+    } \
+    static ossl_inline int sk_##t1##_is_view(const STACK_OF(t1) *sk) \
+    { \
+        return OPENSSL_sk_is_view((const OPENSSL_STACK *)sk); \
+    } \
     static ossl_inline STACK_OF(t1) *sk_##t1##_deep_copy(const STACK_OF(t1) *sk, \
                                                     sk_##t1##_copyfunc copyfunc, \
                                                     sk_##t1##_freefunc freefunc) \
@@ -694,6 +1077,94 @@ extern "C" {
     static ossl_inline sk_##t1##_compfunc sk_##t1##_set_cmp_func(STACK_OF(t1) *sk, sk_##t1##_compfunc compare) \
     { \
         return (sk_##t1##_compfunc)OPENSSL_sk_set_cmp_func((OPENSSL_STACK *)sk, (OPENSSL_sk_compfunc)compare); \
+    } \
+    static ossl_inline void sk_##t1##_stable_sort(STACK_OF(t1) *sk) \
+    { \
+        OPENSSL_sk_stable_sort((OPENSSL_STACK *)sk); \
+    } \
+    static ossl_inline int sk_##t1##_set_stable(STACK_OF(t1) *sk, int stable) \
+    { \
+        return OPENSSL_sk_set_stable((OPENSSL_STACK *)sk, stable); \
+    } \
+    static ossl_inline int sk_##t1##_set_chunked(STACK_OF(t1) *sk, int chunked) \
+    { \
+        return OPENSSL_sk_set_chunked((OPENSSL_STACK *)sk, chunked); \
+    } \
+    static ossl_inline int sk_##t1##_radix_sort(STACK_OF(t1) *sk, sk_##t1##_keyfunc key, int key_bits) \
+    { \
+        return OPENSSL_sk_radix_sort((OPENSSL_STACK *)sk, (OPENSSL_sk_keyfunc)key, key_bits); \
+    } \
+    static ossl_inline sk_##t1##_keyfunc sk_##t1##_set_key_func(STACK_OF(t1) *sk, sk_##t1##_keyfunc key) \
+    { \
+        return (sk_##t1##_keyfunc)OPENSSL_sk_set_key_func((OPENSSL_STACK *)sk, (OPENSSL_sk_keyfunc)key); \
+    } \
+    static ossl_inline int sk_##t1##_build_index(STACK_OF(t1) *sk) \
+    { \
+        return OPENSSL_sk_build_index((OPENSSL_STACK *)sk); \
+    } \
+    static ossl_inline int sk_##t1##_nth_element(STACK_OF(t1) *sk, int nth) \
+    { \
+        return OPENSSL_sk_nth_element((OPENSSL_STACK *)sk, nth); \
+    } \
+    static ossl_inline int sk_##t1##_partial_sort(STACK_OF(t1) *sk, int k) \
+    { \
+        return OPENSSL_sk_partial_sort((OPENSSL_STACK *)sk, k); \
+    } \
+    static ossl_inline int sk_##t1##_top_k(const STACK_OF(t1) *sk, int k, STACK_OF(t1) *out) \
+    { \
+        return OPENSSL_sk_top_k((const OPENSSL_STACK *)sk, k, (OPENSSL_STACK *)out); \
+    } \
+    static ossl_inline int sk_##t1##_set_heap_arity(STACK_OF(t1) *sk, int arity) \
+    { \
+        return OPENSSL_sk_set_heap_arity((OPENSSL_STACK *)sk, arity); \
+    } \
+    static ossl_inline int sk_##t1##_heapify(STACK_OF(t1) *sk) \
+    { \
+        return OPENSSL_sk_heapify((OPENSSL_STACK *)sk); \
+    } \
+    static ossl_inline int sk_##t1##_heap_push(STACK_OF(t1) *sk, t2 *ptr) \
+    { \
+        return OPENSSL_sk_heap_push((OPENSSL_STACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline t2 *sk_##t1##_heap_pop(STACK_OF(t1) *sk) \
+    { \
+        return (t2 *)OPENSSL_sk_heap_pop((OPENSSL_STACK *)sk); \
+    } \
+    static ossl_inline t2 *sk_##t1##_heap_top(const STACK_OF(t1) *sk) \
+    { \
+        return (t2 *)OPENSSL_sk_heap_top((const OPENSSL_STACK *)sk); \
+    } \
+    static ossl_inline int sk_##t1##_heap_update(STACK_OF(t1) *sk, int idx) \
+    { \
+        return OPENSSL_sk_heap_update((OPENSSL_STACK *)sk, idx); \
+    } \
+    static ossl_inline t2 *sk_##t1##_heap_delete(STACK_OF(t1) *sk, int idx) \
+    { \
+        return (t2 *)OPENSSL_sk_heap_delete((OPENSSL_STACK *)sk, idx); \
+    } \
+    static ossl_inline int sk_##t1##_uniq(STACK_OF(t1) *sk, sk_##t1##_freefunc freefunc) \
+    { \
+        return OPENSSL_sk_uniq((OPENSSL_STACK *)sk, (OPENSSL_sk_freefunc)freefunc); \
+    } \
+    static ossl_inline int sk_##t1##_uniq_last(STACK_OF(t1) *sk, sk_##t1##_freefunc freefunc) \
+    { \
+        return OPENSSL_sk_uniq_last((OPENSSL_STACK *)sk, (OPENSSL_sk_freefunc)freefunc); \
+    } \
+    static ossl_inline int sk_##t1##_foreach(const STACK_OF(t1) *sk, sk_##t1##_foreachfunc fn, void *arg) \
+    { \
+        return OPENSSL_sk_foreach((const OPENSSL_STACK *)sk, (OPENSSL_sk_foreachfunc)fn, arg); \
+    } \
+    static ossl_inline int sk_##t1##_foreach_parallel(const STACK_OF(t1) *sk, sk_##t1##_foreachfunc fn, void *arg, int nthreads) \
+    { \
+        return OPENSSL_sk_foreach_parallel((const OPENSSL_STACK *)sk, (OPENSSL_sk_foreachfunc)fn, arg, nthreads); \
+    } \
+    static ossl_inline int sk_##t1##_foreach_prefetch(const STACK_OF(t1) *sk, sk_##t1##_foreachfunc fn, void *arg, int distance, int offset) \
+    { \
+        return OPENSSL_sk_foreach_prefetch((const OPENSSL_STACK *)sk, (OPENSSL_sk_foreachfunc)fn, arg, distance, offset); \
+    } \
+    static ossl_inline int sk_##t1##_iter_next(OPENSSL_SK_ITER *it, t2 **out) \
+    { \
+        return OPENSSL_sk_iter_next(it, (void **)out); \
     }
 
 # define DEFINE_SPECIAL_STACK_OF(t1, t2) SKM_DEFINE_STACK_OF(t1, t2, t2)
@@ -741,489 +1212,7056 @@ DEFINE_SPECIAL_STACK_OF(OPENSSL_BLOCK, void)
 # endif
 #endif
 
+#ifndef HEADER_VALUESTACK_H
+# define HEADER_VALUESTACK_H
 
-#define OPENSSL_malloc(size) malloc(size)
-#define OPENSSL_zalloc(size) calloc(1, size)
-#define OPENSSL_free(mem) free(mem)
-#define OPENSSL_realloc(block, size) realloc(block, size)
-
-static const int min_nodes = 4;
-static const int max_nodes = SIZE_MAX / sizeof(void*) < INT_MAX
-                             ? (int)(SIZE_MAX / sizeof(void*))
-                             : INT_MAX;
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-struct stack_st
-{
-    int num;
-    const void** data;
-    int sorted;
-    int num_alloc;
-    OPENSSL_sk_compfunc comp;
-};
+/*-
+* Value stacks store the elements themselves, |size| bytes each, in one
+* contiguous array instead of an array of pointers to them.  Elements are
+* copied in and out, comparison functions receive pointers to two elements
+* (not to two element pointers as with STACK_OF), and pointers returned by
+* vsk_TYPE_value() are only valid until the next insertion.
+*/
+typedef struct value_stack_st OPENSSL_VSTACK; /* Use VALUE_STACK_OF(...) */
+
+typedef void(*OPENSSL_vsk_freefunc)(void*);
+
+int OPENSSL_vsk_num(const OPENSSL_VSTACK* st);
+void* OPENSSL_vsk_value(const OPENSSL_VSTACK* st, int i);
+void* OPENSSL_vsk_data(const OPENSSL_VSTACK* st);
+int OPENSSL_vsk_set(OPENSSL_VSTACK* st, int i, const void* elem);
+OPENSSL_VSTACK* OPENSSL_vsk_new(size_t size, OPENSSL_sk_compfunc cmp);
+OPENSSL_VSTACK* OPENSSL_vsk_new_null(size_t size);
+OPENSSL_VSTACK* OPENSSL_vsk_new_reserve(size_t size, OPENSSL_sk_compfunc c,
+                                        int n);
+int OPENSSL_vsk_reserve(OPENSSL_VSTACK* st, int n);
+void OPENSSL_vsk_free(OPENSSL_VSTACK* st);
+void OPENSSL_vsk_pop_free(OPENSSL_VSTACK* st, OPENSSL_vsk_freefunc func);
+int OPENSSL_vsk_insert(OPENSSL_VSTACK* st, const void* elem, int where);
+int OPENSSL_vsk_delete(OPENSSL_VSTACK* st, int loc, void* out);
+int OPENSSL_vsk_find(OPENSSL_VSTACK* st, const void* key);
+int OPENSSL_vsk_find_ex(OPENSSL_VSTACK* st, const void* key);
+int OPENSSL_vsk_push(OPENSSL_VSTACK* st, const void* elem);
+int OPENSSL_vsk_unshift(OPENSSL_VSTACK* st, const void* elem);
+int OPENSSL_vsk_shift(OPENSSL_VSTACK* st, void* out);
+int OPENSSL_vsk_pop(OPENSSL_VSTACK* st, void* out);
+void OPENSSL_vsk_zero(OPENSSL_VSTACK* st);
+OPENSSL_sk_compfunc OPENSSL_vsk_set_cmp_func(OPENSSL_VSTACK* st,
+        OPENSSL_sk_compfunc cmp);
+OPENSSL_VSTACK* OPENSSL_vsk_dup(const OPENSSL_VSTACK* st);
+void OPENSSL_vsk_sort(OPENSSL_VSTACK* st);
+int OPENSSL_vsk_is_sorted(const OPENSSL_VSTACK* st);
 
-OPENSSL_sk_compfunc OPENSSL_sk_set_cmp_func(OPENSSL_STACK* sk, OPENSSL_sk_compfunc c)
-{
-    OPENSSL_sk_compfunc old = sk->comp;
+# define VALUE_STACK_OF(type) struct value_stack_st_##type
 
-    if (sk->comp != c)
-    {
-        sk->sorted = 0;
+# define DEFINE_VALUE_STACK_OF(t) \
+    VALUE_STACK_OF(t); \
+    typedef int (*vsk_##t##_compfunc)(const t *a, const t *b); \
+    typedef void (*vsk_##t##_freefunc)(t *a); \
+    static ossl_inline int vsk_##t##_num(const VALUE_STACK_OF(t) *sk) \
+    { \
+        return OPENSSL_vsk_num((const OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline t *vsk_##t##_value(const VALUE_STACK_OF(t) *sk, int idx) \
+    { \
+        return (t *)OPENSSL_vsk_value((const OPENSSL_VSTACK *)sk, idx); \
+    } \
+    static ossl_inline t *vsk_##t##_data(const VALUE_STACK_OF(t) *sk) \
+    { \
+        return (t *)OPENSSL_vsk_data((const OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline VALUE_STACK_OF(t) *vsk_##t##_new(vsk_##t##_compfunc compare) \
+    { \
+        return (VALUE_STACK_OF(t) *)OPENSSL_vsk_new(sizeof(t), (OPENSSL_sk_compfunc)compare); \
+    } \
+    static ossl_inline VALUE_STACK_OF(t) *vsk_##t##_new_null(void) \
+    { \
+        return (VALUE_STACK_OF(t) *)OPENSSL_vsk_new_null(sizeof(t)); \
+    } \
+    static ossl_inline VALUE_STACK_OF(t) *vsk_##t##_new_reserve(vsk_##t##_compfunc compare, int n) \
+    { \
+        return (VALUE_STACK_OF(t) *)OPENSSL_vsk_new_reserve(sizeof(t), (OPENSSL_sk_compfunc)compare, n); \
+    } \
+    static ossl_inline int vsk_##t##_reserve(VALUE_STACK_OF(t) *sk, int n) \
+    { \
+        return OPENSSL_vsk_reserve((OPENSSL_VSTACK *)sk, n); \
+    } \
+    static ossl_inline void vsk_##t##_free(VALUE_STACK_OF(t) *sk) \
+    { \
+        OPENSSL_vsk_free((OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline void vsk_##t##_pop_free(VALUE_STACK_OF(t) *sk, vsk_##t##_freefunc freefunc) \
+    { \
+        OPENSSL_vsk_pop_free((OPENSSL_VSTACK *)sk, (OPENSSL_vsk_freefunc)freefunc); \
+    } \
+    static ossl_inline void vsk_##t##_zero(VALUE_STACK_OF(t) *sk) \
+    { \
+        OPENSSL_vsk_zero((OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline int vsk_##t##_delete(VALUE_STACK_OF(t) *sk, int i, t *out) \
+    { \
+        return OPENSSL_vsk_delete((OPENSSL_VSTACK *)sk, i, (void *)out); \
+    } \
+    static ossl_inline int vsk_##t##_push(VALUE_STACK_OF(t) *sk, const t *elem) \
+    { \
+        return OPENSSL_vsk_push((OPENSSL_VSTACK *)sk, (const void *)elem); \
+    } \
+    static ossl_inline int vsk_##t##_unshift(VALUE_STACK_OF(t) *sk, const t *elem) \
+    { \
+        return OPENSSL_vsk_unshift((OPENSSL_VSTACK *)sk, (const void *)elem); \
+    } \
+    static ossl_inline int vsk_##t##_pop(VALUE_STACK_OF(t) *sk, t *out) \
+    { \
+        return OPENSSL_vsk_pop((OPENSSL_VSTACK *)sk, (void *)out); \
+    } \
+    static ossl_inline int vsk_##t##_shift(VALUE_STACK_OF(t) *sk, t *out) \
+    { \
+        return OPENSSL_vsk_shift((OPENSSL_VSTACK *)sk, (void *)out); \
+    } \
+    static ossl_inline int vsk_##t##_insert(VALUE_STACK_OF(t) *sk, const t *elem, int idx) \
+    { \
+        return OPENSSL_vsk_insert((OPENSSL_VSTACK *)sk, (const void *)elem, idx); \
+    } \
+    static ossl_inline int vsk_##t##_set(VALUE_STACK_OF(t) *sk, int idx, const t *elem) \
+    { \
+        return OPENSSL_vsk_set((OPENSSL_VSTACK *)sk, idx, (const void *)elem); \
+    } \
+    static ossl_inline int vsk_##t##_find(VALUE_STACK_OF(t) *sk, const t *key) \
+    { \
+        return OPENSSL_vsk_find((OPENSSL_VSTACK *)sk, (const void *)key); \
+    } \
+    static ossl_inline int vsk_##t##_find_ex(VALUE_STACK_OF(t) *sk, const t *key) \
+    { \
+        return OPENSSL_vsk_find_ex((OPENSSL_VSTACK *)sk, (const void *)key); \
+    } \
+    static ossl_inline void vsk_##t##_sort(VALUE_STACK_OF(t) *sk) \
+    { \
+        OPENSSL_vsk_sort((OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline int vsk_##t##_is_sorted(const VALUE_STACK_OF(t) *sk) \
+    { \
+        return OPENSSL_vsk_is_sorted((const OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline VALUE_STACK_OF(t) *vsk_##t##_dup(const VALUE_STACK_OF(t) *sk) \
+    { \
+        return (VALUE_STACK_OF(t) *)OPENSSL_vsk_dup((const OPENSSL_VSTACK *)sk); \
+    } \
+    static ossl_inline vsk_##t##_compfunc vsk_##t##_set_cmp_func(VALUE_STACK_OF(t) *sk, vsk_##t##_compfunc compare) \
+    { \
+        return (vsk_##t##_compfunc)OPENSSL_vsk_set_cmp_func((OPENSSL_VSTACK *)sk, (OPENSSL_sk_compfunc)compare); \
     }
-    sk->comp = c;
 
-    return old;
+# ifdef  __cplusplus
 }
+# endif
+#endif
 
-OPENSSL_STACK* OPENSSL_sk_dup(const OPENSSL_STACK* sk)
-{
-    OPENSSL_STACK* ret;
-
-    if ((ret = OPENSSL_malloc(sizeof(*ret))) == NULL)
-    {
-        //        CRYPTOerr(CRYPTO_F_OPENSSL_SK_DUP, ERR_R_MALLOC_FAILURE);
-        return NULL;
-    }
+#ifndef HEADER_SOASTACK_H
+# define HEADER_SOASTACK_H
 
-    /* direct structure assignment */
-    *ret = *sk;
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-    if (sk->num == 0)
-    {
-        /* postpone |ret->data| allocation */
-        ret->data = NULL;
-        ret->num_alloc = 0;
-        return ret;
-    }
-    /* duplicate |sk->data| content */
-    if ((ret->data = OPENSSL_malloc(sizeof(*ret->data) * sk->num_alloc)) == NULL)
-    {
-        goto err;
-    }
-    memcpy((void*)ret->data, (const void*)sk->data, sizeof(void*) * sk->num);
-    return ret;
-err:
-    OPENSSL_sk_free(ret);
+/*-
+* Structure-of-arrays stacks keep one contiguous array per field of a record
+* instead of one array of records.  The fields are given as an X-macro list
+* with one X(type, field) entry per field, for example:
+*
+*  #define EXAMPLE_FIELDS(X) X(int, a) X(float, b)
+*  DEFINE_SOA_STACK_OF(example, EXAMPLE_FIELDS, int, a)
+*
+* defines SOA_STACK_OF(example), the row type SOA_RECORD_OF(example) (a plain
+* struct with members |a| and |b|) used to move rows in and out, and the
+* soa_example_* functions.  The last two arguments are the type and name of
+* the key column that sort and find work on; the comparison function takes
+* two pointers to keys, and NULL means the natural order of the key type.
+*
+* SOA_COLUMN(sk, a) is the array of |a| values itself: loops over it for
+* indices below soa_example_num(sk) touch no other field and vectorize.
+*/
+# define SOA_STACK_OF(name) struct soa_stack_st_##name
+# define SOA_RECORD_OF(name) struct soa_record_st_##name
+# define SOA_COLUMN(sk, field) ((sk)->field)
+
+int OPENSSL_soa_capacity(int num_alloc, int target);
+int OPENSSL_soa_column_resize(void** column, size_t size, int num_alloc);
+
+/* Per-field statements, expanded inside the generated functions */
+# define SOA_X_MEMBER(type, field) type field;
+# define SOA_X_COLUMN(type, field) type *field;
+# define SOA_X_RESIZE(type, field) \
+    if (!OPENSSL_soa_column_resize((void **)&sk->field, sizeof(type), num_alloc)) \
+        return 0;
+# define SOA_X_FREE(type, field) OPENSSL_free(sk->field);
+# define SOA_X_STORE(type, field) sk->field[idx] = row->field;
+# define SOA_X_LOAD(type, field) out->field = sk->field[idx];
+# define SOA_X_OPEN(type, field) \
+    memmove(&sk->field[idx + 1], &sk->field[idx], sizeof(type) * (sk->num - idx));
+# define SOA_X_CLOSE(type, field) \
+    memmove(&sk->field[idx], &sk->field[idx + 1], sizeof(type) * (sk->num - idx - 1));
+# define SOA_X_ALLOC(type, field) \
+    if ((tmp.field = (type *)OPENSSL_malloc(sizeof(type) * sk->num_alloc)) == NULL) \
+        ok = 0;
+# define SOA_X_RELEASE(type, field) OPENSSL_free(tmp.field);
+# define SOA_X_PERMUTE(type, field) \
+    for (i = 0; i < sk->num; i++) \
+        tmp.field[i] = sk->field[perm[i].idx]; \
+    OPENSSL_free(sk->field); \
+    sk->field = tmp.field;
+
+# define DEFINE_SOA_STACK_OF(name, FIELDS, kt, kf) \
+    SOA_RECORD_OF(name) { FIELDS(SOA_X_MEMBER) }; \
+    typedef int (*soa_##name##_compfunc)(const kt *a, const kt *b); \
+    SOA_STACK_OF(name) { \
+        int num; \
+        int num_alloc; \
+        int sorted; \
+        soa_##name##_compfunc comp; \
+        FIELDS(SOA_X_COLUMN) \
+    }; \
+    /* qsort() has no context argument, so each sortkey carries |comp| */ \
+    typedef struct { kt key; int idx; soa_##name##_compfunc comp; } soa_##name##_sortkey; \
+    static ossl_inline int soa_##name##_keycmp(const void *a_, const void *b_) \
+    { \
+        const soa_##name##_sortkey *a = (const soa_##name##_sortkey *)a_; \
+        const soa_##name##_sortkey *b = (const soa_##name##_sortkey *)b_; \
+        int c; \
+        if (a->comp != NULL) { \
+            if ((c = a->comp(&a->key, &b->key)) != 0) \
+                return c; \
+        } else if (a->key != b->key) { \
+            return a->key < b->key ? -1 : 1; \
+        } \
+        return (a->idx > b->idx) - (a->idx < b->idx); \
+    } \
+    static ossl_inline int soa_##name##_keycompare(const SOA_STACK_OF(name) *sk, const kt *a, const kt *b) \
+    { \
+        if (sk->comp != NULL) \
+            return sk->comp(a, b); \
+        return (*a > *b) - (*a < *b); \
+    } \
+    static ossl_inline SOA_STACK_OF(name) *soa_##name##_new(soa_##name##_compfunc compare) \
+    { \
+        SOA_STACK_OF(name) *sk = (SOA_STACK_OF(name) *)OPENSSL_zalloc(sizeof(*sk)); \
+        if (sk != NULL) \
+            sk->comp = compare; \
+        return sk; \
+    } \
+    static ossl_inline SOA_STACK_OF(name) *soa_##name##_new_null(void) \
+    { \
+        return soa_##name##_new(NULL); \
+    } \
+    static ossl_inline void soa_##name##_free(SOA_STACK_OF(name) *sk) \
+    { \
+        if (sk == NULL) \
+            return; \
+        FIELDS(SOA_X_FREE) \
+        OPENSSL_free(sk); \
+    } \
+    static ossl_inline int soa_##name##_num(const SOA_STACK_OF(name) *sk) \
+    { \
+        return sk == NULL ? -1 : sk->num; \
+    } \
+    static ossl_inline int soa_##name##_reserve(SOA_STACK_OF(name) *sk, int n) \
+    { \
+        int num_alloc; \
+        if (sk == NULL) \
+            return 0; \
+        if (n <= sk->num_alloc - sk->num) \
+            return 1; \
+        if (n > INT_MAX - sk->num \
+            || (num_alloc = OPENSSL_soa_capacity(sk->num_alloc, sk->num + n)) == 0) \
+            return 0; \
+        FIELDS(SOA_X_RESIZE) \
+        sk->num_alloc = num_alloc; \
+        return 1; \
+    } \
+    static ossl_inline int soa_##name##_insert(SOA_STACK_OF(name) *sk, const SOA_RECORD_OF(name) *row, int idx) \
+    { \
+        if (sk == NULL || row == NULL || !soa_##name##_reserve(sk, 1)) \
+            return 0; \
+        if (idx < 0 || idx > sk->num) \
+            idx = sk->num; \
+        else if (idx < sk->num) { \
+            FIELDS(SOA_X_OPEN) \
+        } \
+        FIELDS(SOA_X_STORE) \
+        sk->num++; \
+        sk->sorted = 0; \
+        return sk->num; \
+    } \
+    static ossl_inline int soa_##name##_push(SOA_STACK_OF(name) *sk, const SOA_RECORD_OF(name) *row) \
+    { \
+        return soa_##name##_insert(sk, row, -1); \
+    } \
+    static ossl_inline int soa_##name##_unshift(SOA_STACK_OF(name) *sk, const SOA_RECORD_OF(name) *row) \
+    { \
+        return soa_##name##_insert(sk, row, 0); \
+    } \
+    static ossl_inline int soa_##name##_value(const SOA_STACK_OF(name) *sk, int idx, SOA_RECORD_OF(name) *out) \
+    { \
+        if (sk == NULL || out == NULL || idx < 0 || idx >= sk->num) \
+            return 0; \
+        FIELDS(SOA_X_LOAD) \
+        return 1; \
+    } \
+    static ossl_inline int soa_##name##_set(SOA_STACK_OF(name) *sk, int idx, const SOA_RECORD_OF(name) *row) \
+    { \
+        if (sk == NULL || row == NULL || idx < 0 || idx >= sk->num) \
+            return 0; \
+        FIELDS(SOA_X_STORE) \
+        sk->sorted = 0; \
+        return 1; \
+    } \
+    static ossl_inline int soa_##name##_delete(SOA_STACK_OF(name) *sk, int idx, SOA_RECORD_OF(name) *out) \
+    { \
+        if (sk == NULL || idx < 0 || idx >= sk->num) \
+            return 0; \
+        if (out != NULL) { \
+            FIELDS(SOA_X_LOAD) \
+        } \
+        if (idx != sk->num - 1) { \
+            FIELDS(SOA_X_CLOSE) \
+        } \
+        sk->num--; \
+        return 1; \
+    } \
+    static ossl_inline int soa_##name##_pop(SOA_STACK_OF(name) *sk, SOA_RECORD_OF(name) *out) \
+    { \
+        return sk == NULL ? 0 : soa_##name##_delete(sk, sk->num - 1, out); \
+    } \
+    static ossl_inline int soa_##name##_shift(SOA_STACK_OF(name) *sk, SOA_RECORD_OF(name) *out) \
+    { \
+        return soa_##name##_delete(sk, 0, out); \
+    } \
+    static ossl_inline void soa_##name##_zero(SOA_STACK_OF(name) *sk) \
+    { \
+        if (sk != NULL) \
+            sk->num = 0; \
+    } \
+    static ossl_inline soa_##name##_compfunc soa_##name##_set_cmp_func(SOA_STACK_OF(name) *sk, soa_##name##_compfunc compare) \
+    { \
+        soa_##name##_compfunc old = sk->comp; \
+        if (sk->comp != compare) \
+            sk->sorted = 0; \
+        sk->comp = compare; \
+        return old; \
+    } \
+    static ossl_inline int soa_##name##_is_sorted(const SOA_STACK_OF(name) *sk) \
+    { \
+        return sk == NULL ? 1 : sk->sorted; \
+    } \
+    /* Sorts the rows by key column, returns 0 on allocation failure */ \
+    static ossl_inline int soa_##name##_sort(SOA_STACK_OF(name) *sk) \
+    { \
+        SOA_STACK_OF(name) tmp; \
+        soa_##name##_sortkey *perm; \
+        int i, ok = 1; \
+        if (sk == NULL || sk->sorted) \
+            return 1; \
+        if (sk->num < 2) { \
+            sk->sorted = 1; \
+            return 1; \
+        } \
+        perm = (soa_##name##_sortkey *)OPENSSL_malloc(sizeof(*perm) * sk->num); \
+        if (perm == NULL) \
+            return 0; \
+        for (i = 0; i < sk->num; i++) { \
+            perm[i].key = sk->kf[i]; \
+            perm[i].idx = i; \
+            perm[i].comp = sk->comp; \
+        } \
+        qsort(perm, sk->num, sizeof(*perm), soa_##name##_keycmp); \
+        memset(&tmp, 0, sizeof(tmp)); \
+        FIELDS(SOA_X_ALLOC) \
+        if (!ok) { \
+            FIELDS(SOA_X_RELEASE) \
+            OPENSSL_free(perm); \
+            return 0; \
+        } \
+        FIELDS(SOA_X_PERMUTE) \
+        OPENSSL_free(perm); \
+        sk->sorted = 1; \
+        return 1; \
+    } \
+    /* Index of the first row whose key matches |*key|, or -1 */ \
+    static ossl_inline int soa_##name##_find(SOA_STACK_OF(name) *sk, const kt *key) \
+    { \
+        int lo = 0, hi, mid; \
+        if (sk == NULL || key == NULL || sk->num == 0 || !soa_##name##_sort(sk)) \
+            return -1; \
+        hi = sk->num; \
+        while (lo < hi) { \
+            mid = lo + (hi - lo) / 2; \
+            if (soa_##name##_keycompare(sk, &sk->kf[mid], key) < 0) \
+                lo = mid + 1; \
+            else \
+                hi = mid; \
+        } \
+        if (lo < sk->num && soa_##name##_keycompare(sk, &sk->kf[lo], key) == 0) \
+            return lo; \
+        return -1; \
+    }
+
+# ifdef  __cplusplus
+}
+# endif
+#endif
+
+#ifndef HEADER_STRSTACK_H
+# define HEADER_STRSTACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*-
+* String stacks: an alternative to STACK_OF(OPENSSL_STRING) for name-heavy
+* lookups.  Strings are interned in an OPENSSL_STR_POOL, an arena plus a hash
+* set, so equal strings share one copy and one pointer.  Each stack entry
+* keeps the interned pointer with its length and 64-bit hash, which lets
+* equality tests go hash-then-pointer and ordering use a length-aware memcmp
+* instead of strcmp.
+*
+* A pool can be shared by several stacks (it is reference counted) or, when
+* NULL is passed to OPENSSL_strsk_new(), created privately for the stack.
+* Interned strings stay valid until the pool is freed, so strings returned
+* by OPENSSL_strsk_delete() and OPENSSL_strsk_pop() need no freeing.  Pools
+* are not thread-safe.
+*/
+typedef struct str_pool_st OPENSSL_STR_POOL;
+typedef struct str_stack_st OPENSSL_STRSTACK;
+
+OPENSSL_STR_POOL* OPENSSL_str_pool_new(void);
+void OPENSSL_str_pool_free(OPENSSL_STR_POOL* pool);
+const char* OPENSSL_str_pool_intern(OPENSSL_STR_POOL* pool, const char* str,
+                                    size_t len);
+const char* OPENSSL_str_pool_lookup(const OPENSSL_STR_POOL* pool,
+                                    const char* str, size_t len);
+
+OPENSSL_STRSTACK* OPENSSL_strsk_new(OPENSSL_STR_POOL* pool);
+void OPENSSL_strsk_free(OPENSSL_STRSTACK* st);
+OPENSSL_STRSTACK* OPENSSL_strsk_dup(const OPENSSL_STRSTACK* st);
+int OPENSSL_strsk_num(const OPENSSL_STRSTACK* st);
+const char* OPENSSL_strsk_value(const OPENSSL_STRSTACK* st, int i);
+size_t OPENSSL_strsk_len(const OPENSSL_STRSTACK* st, int i);
+int OPENSSL_strsk_insert(OPENSSL_STRSTACK* st, const char* str, int where);
+int OPENSSL_strsk_insert_len(OPENSSL_STRSTACK* st, const char* str,
+                             size_t len, int where);
+int OPENSSL_strsk_push(OPENSSL_STRSTACK* st, const char* str);
+const char* OPENSSL_strsk_delete(OPENSSL_STRSTACK* st, int loc);
+const char* OPENSSL_strsk_pop(OPENSSL_STRSTACK* st);
+void OPENSSL_strsk_zero(OPENSSL_STRSTACK* st);
+int OPENSSL_strsk_find(const OPENSSL_STRSTACK* st, const char* str);
+int OPENSSL_strsk_find_len(const OPENSSL_STRSTACK* st, const char* str,
+                           size_t len);
+void OPENSSL_strsk_sort(OPENSSL_STRSTACK* st);
+int OPENSSL_strsk_is_sorted(const OPENSSL_STRSTACK* st);
+
+# ifdef  __cplusplus
+}
+# endif
+#endif
+
+#ifndef HEADER_CSTACK_H
+# define HEADER_CSTACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*-
+* Compressed stacks hold pointers into one arena of less than 4GB as 32-bit
+* offsets from its base, halving the memory and cache footprint of a stack
+* on 64-bit hosts.  The API is that of STACK_OF, with the same comparison
+* functions (they get pointers to decompressed element pointers), except
+* that inserting a pointer outside of the arena fails.
+*
+* The offsets themselves, OPENSSL_CSK_NULL for NULL, are available for
+* direct scans.  OBJ_bsearch_ex_() cannot take a STACK_OF comparison function
+* over them, as it would get a bare uint32_t offset with no arena to resolve
+* it against; OPENSSL_csk_bsearch() searches a stack sorted in the order of
+* |cmp| for |key| with such a function, without sorting it, and returns the
+* index as OBJ_bsearch_ex_() with |flags| would, or -1.
+*/
+typedef struct compressed_stack_st OPENSSL_CSTACK; /* Use CSTACK_OF(...) */
+
+# define OPENSSL_CSK_NULL                0xffffffffU
+
+OPENSSL_CSTACK* OPENSSL_csk_new(const void* base, size_t size,
+                                OPENSSL_sk_compfunc cmp);
+OPENSSL_CSTACK* OPENSSL_csk_new_reserve(const void* base, size_t size,
+                                        OPENSSL_sk_compfunc cmp, int n);
+int OPENSSL_csk_reserve(OPENSSL_CSTACK* st, int n);
+void OPENSSL_csk_free(OPENSSL_CSTACK* st);
+void OPENSSL_csk_pop_free(OPENSSL_CSTACK* st, OPENSSL_sk_freefunc func);
+OPENSSL_CSTACK* OPENSSL_csk_dup(const OPENSSL_CSTACK* st);
+int OPENSSL_csk_num(const OPENSSL_CSTACK* st);
+void* OPENSSL_csk_value(const OPENSSL_CSTACK* st, int i);
+void* OPENSSL_csk_set(OPENSSL_CSTACK* st, int i, const void* data);
+int OPENSSL_csk_insert(OPENSSL_CSTACK* st, const void* data, int where);
+void* OPENSSL_csk_delete(OPENSSL_CSTACK* st, int loc);
+int OPENSSL_csk_push(OPENSSL_CSTACK* st, const void* data);
+int OPENSSL_csk_unshift(OPENSSL_CSTACK* st, const void* data);
+void* OPENSSL_csk_shift(OPENSSL_CSTACK* st);
+void* OPENSSL_csk_pop(OPENSSL_CSTACK* st);
+void OPENSSL_csk_zero(OPENSSL_CSTACK* st);
+int OPENSSL_csk_find(OPENSSL_CSTACK* st, const void* data);
+int OPENSSL_csk_find_ex(OPENSSL_CSTACK* st, const void* data);
+OPENSSL_sk_compfunc OPENSSL_csk_set_cmp_func(OPENSSL_CSTACK* st,
+        OPENSSL_sk_compfunc cmp);
+void OPENSSL_csk_sort(OPENSSL_CSTACK* st);
+int OPENSSL_csk_is_sorted(const OPENSSL_CSTACK* st);
+const uint32_t* OPENSSL_csk_offsets(const OPENSSL_CSTACK* st);
+void* OPENSSL_csk_ptr(const OPENSSL_CSTACK* st, uint32_t off);
+int OPENSSL_csk_bsearch(const OPENSSL_CSTACK* st, const void* key,
+                        OPENSSL_sk_compfunc cmp, int flags);
+
+# define CSTACK_OF(type) struct compressed_stack_st_##type
+
+# define DEFINE_CSTACK_OF(t) \
+    CSTACK_OF(t); \
+    typedef int (*csk_##t##_compfunc)(const t * const *a, const t *const *b); \
+    typedef void (*csk_##t##_freefunc)(t *a); \
+    static ossl_inline int csk_##t##_num(const CSTACK_OF(t) *sk) \
+    { \
+        return OPENSSL_csk_num((const OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline t *csk_##t##_value(const CSTACK_OF(t) *sk, int idx) \
+    { \
+        return (t *)OPENSSL_csk_value((const OPENSSL_CSTACK *)sk, idx); \
+    } \
+    static ossl_inline CSTACK_OF(t) *csk_##t##_new(const void *base, size_t size, csk_##t##_compfunc compare) \
+    { \
+        return (CSTACK_OF(t) *)OPENSSL_csk_new(base, size, (OPENSSL_sk_compfunc)compare); \
+    } \
+    static ossl_inline CSTACK_OF(t) *csk_##t##_new_reserve(const void *base, size_t size, csk_##t##_compfunc compare, int n) \
+    { \
+        return (CSTACK_OF(t) *)OPENSSL_csk_new_reserve(base, size, (OPENSSL_sk_compfunc)compare, n); \
+    } \
+    static ossl_inline int csk_##t##_reserve(CSTACK_OF(t) *sk, int n) \
+    { \
+        return OPENSSL_csk_reserve((OPENSSL_CSTACK *)sk, n); \
+    } \
+    static ossl_inline void csk_##t##_free(CSTACK_OF(t) *sk) \
+    { \
+        OPENSSL_csk_free((OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline void csk_##t##_pop_free(CSTACK_OF(t) *sk, csk_##t##_freefunc freefunc) \
+    { \
+        OPENSSL_csk_pop_free((OPENSSL_CSTACK *)sk, (OPENSSL_sk_freefunc)freefunc); \
+    } \
+    static ossl_inline CSTACK_OF(t) *csk_##t##_dup(const CSTACK_OF(t) *sk) \
+    { \
+        return (CSTACK_OF(t) *)OPENSSL_csk_dup((const OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline void csk_##t##_zero(CSTACK_OF(t) *sk) \
+    { \
+        OPENSSL_csk_zero((OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline t *csk_##t##_delete(CSTACK_OF(t) *sk, int i) \
+    { \
+        return (t *)OPENSSL_csk_delete((OPENSSL_CSTACK *)sk, i); \
+    } \
+    static ossl_inline int csk_##t##_push(CSTACK_OF(t) *sk, t *ptr) \
+    { \
+        return OPENSSL_csk_push((OPENSSL_CSTACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline int csk_##t##_unshift(CSTACK_OF(t) *sk, t *ptr) \
+    { \
+        return OPENSSL_csk_unshift((OPENSSL_CSTACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline t *csk_##t##_pop(CSTACK_OF(t) *sk) \
+    { \
+        return (t *)OPENSSL_csk_pop((OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline t *csk_##t##_shift(CSTACK_OF(t) *sk) \
+    { \
+        return (t *)OPENSSL_csk_shift((OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline int csk_##t##_insert(CSTACK_OF(t) *sk, t *ptr, int idx) \
+    { \
+        return OPENSSL_csk_insert((OPENSSL_CSTACK *)sk, (const void *)ptr, idx); \
+    } \
+    static ossl_inline t *csk_##t##_set(CSTACK_OF(t) *sk, int idx, t *ptr) \
+    { \
+        return (t *)OPENSSL_csk_set((OPENSSL_CSTACK *)sk, idx, (const void *)ptr); \
+    } \
+    static ossl_inline int csk_##t##_find(CSTACK_OF(t) *sk, t *ptr) \
+    { \
+        return OPENSSL_csk_find((OPENSSL_CSTACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline int csk_##t##_find_ex(CSTACK_OF(t) *sk, t *ptr) \
+    { \
+        return OPENSSL_csk_find_ex((OPENSSL_CSTACK *)sk, (const void *)ptr); \
+    } \
+    static ossl_inline int csk_##t##_bsearch(const CSTACK_OF(t) *sk, const t *key, csk_##t##_compfunc compare, int flags) \
+    { \
+        return OPENSSL_csk_bsearch((const OPENSSL_CSTACK *)sk, (const void *)key, (OPENSSL_sk_compfunc)compare, flags); \
+    } \
+    static ossl_inline void csk_##t##_sort(CSTACK_OF(t) *sk) \
+    { \
+        OPENSSL_csk_sort((OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline int csk_##t##_is_sorted(const CSTACK_OF(t) *sk) \
+    { \
+        return OPENSSL_csk_is_sorted((const OPENSSL_CSTACK *)sk); \
+    } \
+    static ossl_inline csk_##t##_compfunc csk_##t##_set_cmp_func(CSTACK_OF(t) *sk, csk_##t##_compfunc compare) \
+    { \
+        return (csk_##t##_compfunc)OPENSSL_csk_set_cmp_func((OPENSSL_CSTACK *)sk, (OPENSSL_sk_compfunc)compare); \
+    }
+
+# ifdef  __cplusplus
+}
+# endif
+#endif
+
+
+#define OPENSSL_malloc(size) malloc(size)
+#define OPENSSL_zalloc(size) calloc(1, size)
+#define OPENSSL_free(mem) free(mem)
+#define OPENSSL_realloc(block, size) realloc(block, size)
+
+#ifdef OPENSSL_THREADS
+# include <pthread.h>
+# include <sched.h>
+# include <unistd.h>
+#endif
+#ifdef OPENSSL_SK_TRACE
+# include <time.h>
+#endif
+
+/*
+* Prefetch distance chosen by OPENSSL_SK_PREFETCH_AUTO.  Below
+* OPENSSL_SK_PREFETCH_MIN_NUM elements the objects are assumed to be cached
+* already and no prefetches are issued.
+*/
+#ifndef OPENSSL_SK_PREFETCH_DISTANCE
+# define OPENSSL_SK_PREFETCH_DISTANCE    8
+#endif
+#ifndef OPENSSL_SK_PREFETCH_MIN_NUM
+# define OPENSSL_SK_PREFETCH_MIN_NUM     256
+#endif
+
+/* Most worker threads OPENSSL_sk_foreach_parallel() keeps around */
+#ifndef OPENSSL_SK_MAX_WORKERS
+# define OPENSSL_SK_MAX_WORKERS          64
+#endif
+
+/*
+* Search index (OPENSSL_sk_set_key_func()): the largest distance between
+* the predicted and the actual position of a key, and the smallest stack
+* for which sorting builds the index by itself.
+*/
+#ifndef OPENSSL_SK_INDEX_EPSILON
+# define OPENSSL_SK_INDEX_EPSILON        16
+#endif
+#ifndef OPENSSL_SK_INDEX_MIN_NUM
+# define OPENSSL_SK_INDEX_MIN_NUM        1024
+#endif
+
+/*
+* Stack pool: per thread, up to OPENSSL_SK_POOL_HEADERS headers and, for
+* each of the SK_POOL_CLASSES size classes of min_nodes << class pointers,
+* up to OPENSSL_SK_POOL_BUFFERS data buffers.  Thread-local storage needs
+* GCC's __thread when threads are enabled, so the pool is left out without
+* it.
+*/
+#ifndef OPENSSL_SK_POOL_HEADERS
+# define OPENSSL_SK_POOL_HEADERS         16
+#endif
+#ifndef OPENSSL_SK_POOL_BUFFERS
+# define OPENSSL_SK_POOL_BUFFERS         8
+#endif
+#define SK_POOL_CLASSES                 8
+
+#ifndef OPENSSL_NO_SK_POOL
+# if !defined(OPENSSL_THREADS)
+#  define SK_POOL_TLS
+# elif defined(__GNUC__)
+#  define SK_POOL_TLS __thread
+# else
+#  define OPENSSL_NO_SK_POOL
+# endif
+#endif
+
+/* Piecewise-linear model of key -> position, see sk_index_build() */
+typedef struct sk_index_seg_st
+{
+    uint64_t key;               /* first key of the segment */
+    double slope;               /* positions per key unit */
+    int pos;                    /* position of |key| */
+} SK_INDEX_SEG;
+
+typedef struct sk_index_st
+{
+    unsigned int gen;           /* value of |st->gen| it was built for */
+    int nseg;                   /* 0: the keys do not allow an index */
+    SK_INDEX_SEG* seg;
+} SK_INDEX;
+
+/*
+* Chunked storage, see OPENSSL_sk_set_chunked(): a tiered vector of blocks
+* of SK_CHUNK slots, each a circular buffer, all full but the last one.
+* Chunked stacks below SK_CHUNK_MIN_NUM elements stay contiguous.
+*/
+#ifndef OPENSSL_SK_CHUNK_BITS
+# define OPENSSL_SK_CHUNK_BITS           9
+#endif
+#define SK_CHUNK                        (1 << OPENSSL_SK_CHUNK_BITS)
+#define SK_CHUNK_MASK                   (SK_CHUNK - 1)
+#define SK_CHUNK_MIN_NUM                (4 * SK_CHUNK)
+
+typedef struct sk_chunks_st
+{
+    const void*** blk;
+    int* head;                  /* slot of the first element of each block */
+    int nblk;
+    int blk_alloc;
+    const void** spare;         /* last freed block, saves churn at a boundary */
+} SK_CHUNKS;
+
+static const int min_nodes = 4;
+static const int max_nodes = SIZE_MAX / sizeof(void*) < INT_MAX
+                             ? (int)(SIZE_MAX / sizeof(void*))
+                             : INT_MAX;
+
+struct stack_st
+{
+    int num;
+    const void** data;
+    int sorted;
+    int num_alloc;
+    OPENSSL_sk_compfunc comp;
+    int stable;                 /* sort with OPENSSL_sk_stable_sort() */
+    const void** scratch;       /* merge buffer kept across stable sorts */
+    int scratch_alloc;
+    int heap_arity;             /* 4 for a 4-ary heap, binary otherwise */
+    unsigned int gen;           /* bumped on any change of contents or order */
+    OPENSSL_sk_keyfunc key;     /* numeric key of the search index */
+    SK_INDEX* index;
+    const struct stack_st* parent;  /* stack a view looks into */
+    unsigned int parent_gen;        /* |parent->gen| when the view was taken */
+    int view_owned;             /* view holding a copy, see OPENSSL_sk_view() */
+    int chunked;                /* middle inserts and deletes use |chunks| */
+    SK_CHUNKS* chunks;          /* holds the elements instead of |data| */
+    int embedded;               /* header inside a collector, never freed */
+#ifdef OPENSSL_SK_TRACE
+    uint32_t trace_id;          /* 0 until first traced */
+#endif
+};
+
+/*
+* Views are read-only and only valid while their parent is alive and
+* unchanged.  SK_VIEW_CHECK() detects a parent changed since the view was
+* taken; it dereferences |parent|, so it cannot detect a freed one.
+*/
+static ossl_inline int sk_is_view(const OPENSSL_STACK* st)
+{
+    return st->parent != NULL;
+}
+
+#define SK_VIEW_CHECK(st) \
+    assert((st) == NULL || (st)->parent == NULL \
+           || (st)->parent->gen == (st)->parent_gen)
+
+#ifdef OPENSSL_SK_TRACE
+/*
+* Operation trace, see OPENSSL_sk_trace_start().  Records are written
+* through stdio under |sk_trace_lock|, which also guards the stack ids;
+* |sk_trace_on| lets untraced processes skip the lock: -1 until
+* OPENSSL_SK_TRACE_FILE has been looked at, then whether a log is open.
+*/
+static FILE* sk_trace_file;
+static int sk_trace_on = -1;
+static uint32_t sk_trace_next_id;
+static uint64_t sk_trace_epoch;
+
+# ifdef OPENSSL_THREADS
+static pthread_mutex_t sk_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#  define SK_TRACE_LOCK()         pthread_mutex_lock(&sk_trace_lock)
+#  define SK_TRACE_UNLOCK()       pthread_mutex_unlock(&sk_trace_lock)
+#  define SK_TRACE_ON()           __atomic_load_n(&sk_trace_on, __ATOMIC_RELAXED)
+#  define SK_TRACE_SET_ON(v)      __atomic_store_n(&sk_trace_on, v, __ATOMIC_RELAXED)
+# else
+#  define SK_TRACE_LOCK()         ((void)0)
+#  define SK_TRACE_UNLOCK()       ((void)0)
+#  define SK_TRACE_ON()           (sk_trace_on)
+#  define SK_TRACE_SET_ON(v)      (sk_trace_on = (v))
+# endif
+
+static uint64_t sk_trace_now(void)
+{
+# if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+# elif defined(TIME_UTC)
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+# else
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+# endif
+}
+
+/* Called locked */
+static void sk_trace_close(void)
+{
+    if (sk_trace_file != NULL)
+    {
+        fclose(sk_trace_file);
+        sk_trace_file = NULL;
+    }
+    SK_TRACE_SET_ON(0);
+}
+
+/* Called locked */
+static int sk_trace_open(const char* path)
+{
+    FILE* f;
+
+    sk_trace_close();
+    if (path == NULL || (f = fopen(path, "wb")) == NULL)
+    {
+        return 0;
+    }
+    if (fwrite(OPENSSL_SK_TRACE_MAGIC, 1, OPENSSL_SK_TRACE_MAGIC_LEN, f)
+        != OPENSSL_SK_TRACE_MAGIC_LEN)
+    {
+        fclose(f);
+        return 0;
+    }
+    sk_trace_file = f;
+    sk_trace_epoch = sk_trace_now();
+    SK_TRACE_SET_ON(1);
+    return 1;
+}
+
+/* Called locked, hands out the id of |st| on first use */
+static uint32_t sk_trace_id(const OPENSSL_STACK* st)
+{
+    OPENSSL_STACK* s = (OPENSSL_STACK*)st;
+
+    if (s->trace_id == 0)
+    {
+        s->trace_id = ++sk_trace_next_id;
+    }
+    return s->trace_id;
+}
+
+/*
+* Records |op| on |st|.  For a copy, |src| is the stack it was made from:
+* |st| has its id, which is dropped before anything else.
+*/
+static void sk_trace(int op, const OPENSSL_STACK* st, int index,
+                     const OPENSSL_STACK* src)
+{
+    OPENSSL_SK_TRACE_REC rec;
+
+    if (st == NULL)
+    {
+        return;
+    }
+    if (src != NULL)
+    {
+        ((OPENSSL_STACK*)st)->trace_id = 0;
+    }
+    if (SK_TRACE_ON() == 0)
+    {
+        return;
+    }
+
+    SK_TRACE_LOCK();
+    if (sk_trace_on == -1 && !sk_trace_open(getenv("OPENSSL_SK_TRACE_FILE")))
+    {
+        SK_TRACE_SET_ON(0);
+    }
+    if (sk_trace_file != NULL)
+    {
+        memset(&rec, 0, sizeof(rec));
+        rec.time = sk_trace_now() - sk_trace_epoch;
+        rec.stack = sk_trace_id(st);
+        rec.op = (uint8_t)op;
+        rec.flags = st->comp != NULL ? OPENSSL_SK_TRACE_CMP : 0;
+        rec.index = src != NULL ? (int32_t)sk_trace_id(src) : index;
+        rec.num = st->num;
+        if (fwrite(&rec, sizeof(rec), 1, sk_trace_file) != 1)
+        {
+            /* a short write would corrupt the rest of the log */
+            sk_trace_close();
+        }
+    }
+    SK_TRACE_UNLOCK();
+}
+
+int OPENSSL_sk_trace_start(const char* path)
+{
+    int ret;
+
+    SK_TRACE_LOCK();
+    ret = sk_trace_open(path);
+    SK_TRACE_UNLOCK();
+    return ret;
+}
+
+/* Also keeps OPENSSL_SK_TRACE_FILE from starting a trace afterwards */
+void OPENSSL_sk_trace_stop(void)
+{
+    SK_TRACE_LOCK();
+    sk_trace_close();
+    SK_TRACE_UNLOCK();
+}
+
+# define SK_TRACE(op, st, index) \
+    sk_trace(OPENSSL_SK_OP_##op, st, index, NULL)
+# define SK_TRACE_DUP(st, src) \
+    sk_trace(OPENSSL_SK_OP_DUP, st, 0, src)
+#else
+int OPENSSL_sk_trace_start(const char* path)
+{
+    (void)path;
+    return 0;
+}
+
+void OPENSSL_sk_trace_stop(void)
+{
+}
+
+# define SK_TRACE(op, st, index)        ((void)0)
+# define SK_TRACE_DUP(st, src)          ((void)0)
+#endif
+
+#ifndef OPENSSL_NO_SK_POOL
+typedef struct sk_pool_buf_st
+{
+    const void** data;
+    int num_alloc;
+} SK_POOL_BUF;
+
+typedef struct sk_pool_st
+{
+    OPENSSL_STACK* headers[OPENSSL_SK_POOL_HEADERS];
+    int nheaders;
+    /* class c holds buffers of [min_nodes << c, min_nodes << (c + 1)) */
+    SK_POOL_BUF bufs[SK_POOL_CLASSES][OPENSSL_SK_POOL_BUFFERS];
+    int nbufs[SK_POOL_CLASSES];
+    size_t header_hits, header_misses, buffer_hits, buffer_misses;
+    int registered;
+} SK_POOL;
+
+static SK_POOL_TLS SK_POOL sk_pool;
+
+static void sk_pool_release(SK_POOL* pool)
+{
+    int c;
+
+    while (pool->nheaders > 0)
+    {
+        OPENSSL_free(pool->headers[--pool->nheaders]);
+    }
+    for (c = 0; c < SK_POOL_CLASSES; c++)
+    {
+        while (pool->nbufs[c] > 0)
+        {
+            OPENSSL_free((void*)pool->bufs[c][--pool->nbufs[c]].data);
+        }
+    }
+}
+
+/*
+* Empties the pool of the thread calling exit(), normally the main thread,
+* for which the thread exit destructor below does not run.
+*/
+static void sk_pool_exit(void)
+{
+    sk_pool_release(&sk_pool);
+}
+
+# ifdef OPENSSL_THREADS
+/* Empties the pool of a thread when it exits */
+static pthread_key_t sk_pool_key;
+static pthread_once_t sk_pool_once = PTHREAD_ONCE_INIT;
+
+static void sk_pool_thread_exit(void* pool)
+{
+    sk_pool_release((SK_POOL*)pool);
+    /* stacks freed by later destructors register the pool again */
+    ((SK_POOL*)pool)->registered = 0;
+}
+
+static void sk_pool_init_key(void)
+{
+    pthread_key_create(&sk_pool_key, sk_pool_thread_exit);
+    atexit(sk_pool_exit);
+}
+# endif
+
+/* The pool of the calling thread, once something is to be put into it */
+static SK_POOL* sk_pool_get(void)
+{
+    if (!sk_pool.registered)
+    {
+# ifdef OPENSSL_THREADS
+        pthread_once(&sk_pool_once, sk_pool_init_key);
+        pthread_setspecific(sk_pool_key, &sk_pool);
+# else
+        atexit(sk_pool_exit);
+# endif
+        sk_pool.registered = 1;
+    }
+    return &sk_pool;
+}
+#endif
+
+/* A zeroed stack header */
+static OPENSSL_STACK* sk_header_alloc(void)
+{
+#ifndef OPENSSL_NO_SK_POOL
+    OPENSSL_STACK* st;
+
+    if (sk_pool.nheaders > 0)
+    {
+        sk_pool.header_hits++;
+        st = sk_pool.headers[--sk_pool.nheaders];
+        memset((void*)st, 0, sizeof(*st));
+        return st;
+    }
+    sk_pool.header_misses++;
+#endif
+    return (OPENSSL_STACK*)OPENSSL_zalloc(sizeof(OPENSSL_STACK));
+}
+
+static void sk_header_release(OPENSSL_STACK* st)
+{
+#ifndef OPENSSL_NO_SK_POOL
+    SK_POOL* pool = sk_pool_get();
+
+    if (pool->nheaders < OPENSSL_SK_POOL_HEADERS)
+    {
+        pool->headers[pool->nheaders++] = st;
+        return;
+    }
+#endif
+    OPENSSL_free((void*)st);
+}
+
+/*
+* A data buffer for at least |n| pointers, not zeroed.  Its actual size is
+* stored in |*num_alloc|.
+*/
+static const void** sk_data_alloc(int n, int* num_alloc)
+{
+    const void** data;
+#ifndef OPENSSL_NO_SK_POOL
+    SK_POOL_BUF* b;
+    int c = 0, i;
+
+    /* the class of |n| may hold big enough buffers, the next one does */
+    while (c + 1 < SK_POOL_CLASSES && (min_nodes << (c + 1)) <= n)
+    {
+        c++;
+    }
+    for (; c < SK_POOL_CLASSES && (min_nodes << c) / 2 <= n; c++)
+    {
+        for (i = sk_pool.nbufs[c] - 1; i >= 0; i--)
+        {
+            b = &sk_pool.bufs[c][i];
+            if (b->num_alloc >= n)
+            {
+                data = b->data;
+                *num_alloc = b->num_alloc;
+                *b = sk_pool.bufs[c][--sk_pool.nbufs[c]];
+                sk_pool.buffer_hits++;
+                return data;
+            }
+        }
+    }
+    sk_pool.buffer_misses++;
+#endif
+    if ((data = (const void**)OPENSSL_malloc(sizeof(void*) * n)) != NULL)
+    {
+        *num_alloc = n;
+    }
+    return data;
+}
+
+static void sk_data_release(const void** data, int num_alloc)
+{
+#ifdef OPENSSL_NO_SK_POOL
+    (void)num_alloc;
+#else
+    SK_POOL* pool;
+    int c = 0;
+
+    if (data != NULL && num_alloc >= min_nodes)
+    {
+        while (c + 1 < SK_POOL_CLASSES && (min_nodes << (c + 1)) <= num_alloc)
+        {
+            c++;
+        }
+        pool = sk_pool_get();
+        if (num_alloc < (min_nodes << (c + 1))
+            && pool->nbufs[c] < OPENSSL_SK_POOL_BUFFERS)
+        {
+            pool->bufs[c][pool->nbufs[c]].data = data;
+            pool->bufs[c][pool->nbufs[c]].num_alloc = num_alloc;
+            pool->nbufs[c]++;
+            return;
+        }
+    }
+#endif
+    OPENSSL_free((void*)data);
+}
+
+void OPENSSL_sk_pool_stats(OPENSSL_SK_POOL_STATS* stats)
+{
+#ifndef OPENSSL_NO_SK_POOL
+    int c, i;
+#endif
+
+    memset(stats, 0, sizeof(*stats));
+#ifndef OPENSSL_NO_SK_POOL
+    stats->header_hits = sk_pool.header_hits;
+    stats->header_misses = sk_pool.header_misses;
+    stats->buffer_hits = sk_pool.buffer_hits;
+    stats->buffer_misses = sk_pool.buffer_misses;
+    stats->headers_cached = sk_pool.nheaders;
+    stats->bytes_cached = sizeof(OPENSSL_STACK) * sk_pool.nheaders;
+    for (c = 0; c < SK_POOL_CLASSES; c++)
+    {
+        stats->buffers_cached += sk_pool.nbufs[c];
+        for (i = 0; i < sk_pool.nbufs[c]; i++)
+        {
+            stats->bytes_cached += sizeof(void*) * sk_pool.bufs[c][i].num_alloc;
+        }
+    }
+#endif
+}
+
+/* Frees everything cached by the calling thread */
+void OPENSSL_sk_pool_flush(void)
+{
+#ifndef OPENSSL_NO_SK_POOL
+    sk_pool_release(&sk_pool);
+#endif
+}
+
+/* Slot of element |i| of a chunked stack */
+static ossl_inline const void** sk_chunk_slot(const OPENSSL_STACK* st, int i)
+{
+    const SK_CHUNKS* ch = st->chunks;
+    int b = i >> OPENSSL_SK_CHUNK_BITS;
+
+    return &ch->blk[b][(ch->head[b] + i) & SK_CHUNK_MASK];
+}
+
+/* Slot of element |i|, chunked or not */
+static ossl_inline const void** sk_slot(const OPENSSL_STACK* st, int i)
+{
+    return st->chunks != NULL ? sk_chunk_slot(st, i) : &st->data[i];
+}
+
+static void sk_chunks_free(SK_CHUNKS* ch)
+{
+    int b;
+
+    for (b = 0; b < ch->nblk; b++)
+    {
+        OPENSSL_free((void*)ch->blk[b]);
+    }
+    OPENSSL_free((void*)ch->spare);
+    OPENSSL_free((void*)ch->blk);
+    OPENSSL_free(ch->head);
+    OPENSSL_free(ch);
+}
+
+/* Copies elements |start..start + n) of |st|, chunked or not, to |out| */
+static void sk_copy_range(const OPENSSL_STACK* st, int start, int n,
+                          const void** out)
+{
+    const SK_CHUNKS* ch = st->chunks;
+    int b, o, h, m, first;
+
+    if (ch == NULL)
+    {
+        if (n > 0)
+        {
+            memcpy((void*)out, (const void*)&st->data[start],
+                   sizeof(void*) * n);
+        }
+        return;
+    }
+    while (n > 0)
+    {
+        b = start >> OPENSSL_SK_CHUNK_BITS;
+        o = start & SK_CHUNK_MASK;
+        h = (ch->head[b] + o) & SK_CHUNK_MASK;
+        m = n < SK_CHUNK - o ? n : SK_CHUNK - o;
+        first = m < SK_CHUNK - h ? m : SK_CHUNK - h;
+        memcpy((void*)out, (const void*)&ch->blk[b][h], sizeof(void*) * first);
+        memcpy((void*)(out + first), (const void*)ch->blk[b],
+               sizeof(void*) * (m - first));
+        out += m;
+        start += m;
+        n -= m;
+    }
+}
+
+/*
+* The elements of |st| as one array: |st->data|, or for a chunked stack a
+* copy that is also stored in |*tmp| for the caller to free.  Lets the
+* functions that only read a stack leave its blocks alone.  Returns 0 if out
+* of memory.
+*/
+static int sk_read_array(const OPENSSL_STACK* st, const void*** data,
+                         const void*** tmp)
+{
+    *tmp = NULL;
+    if (st->chunks == NULL)
+    {
+        *data = st->data;
+        return 1;
+    }
+    if ((*tmp = (const void**)OPENSSL_malloc(sizeof(void*) * st->num))
+        == NULL)
+    {
+        return 0;
+    }
+    sk_copy_range(st, 0, st->num, *tmp);
+    *data = *tmp;
+    return 1;
+}
+
+/*
+* Moves the elements of a chunked stack back to |st->data|, for the
+* functions that modify the stack and need its elements contiguous; the
+* ones that only read it go through sk_slot() or sk_read_array() instead,
+* so that they neither undo the chunking nor write to a stack other threads
+* may be reading.  Chunked stacks keep |data| big enough for all their
+* elements, so this cannot fail.
+*/
+static void sk_flatten(OPENSSL_STACK* st)
+{
+    if (st == NULL || st->chunks == NULL)
+    {
+        return;
+    }
+    sk_copy_range(st, 0, st->num, st->data);
+    sk_chunks_free(st->chunks);
+    st->chunks = NULL;
+}
+
+/* Makes room in the block list of |ch| for one more block */
+static int sk_chunks_grow(SK_CHUNKS* ch)
+{
+    const void*** blk;
+    int* head;
+    int n;
+
+    if (ch->nblk < ch->blk_alloc)
+    {
+        return 1;
+    }
+    n = ch->blk_alloc < 4 ? 4 : ch->blk_alloc + ch->blk_alloc / 2;
+    if ((blk = (const void***)OPENSSL_realloc((void*)ch->blk,
+               sizeof(*blk) * n)) == NULL)
+    {
+        return 0;
+    }
+    ch->blk = blk;
+    if ((head = (int*)OPENSSL_realloc(ch->head, sizeof(*head) * n)) == NULL)
+    {
+        return 0;
+    }
+    ch->head = head;
+    ch->blk_alloc = n;
+    return 1;
+}
+
+/* Appends an empty block to |ch| */
+static int sk_chunks_add(SK_CHUNKS* ch)
+{
+    const void** blk = ch->spare;
+
+    if (!sk_chunks_grow(ch))
+    {
+        return 0;
+    }
+    if (blk == NULL
+        && (blk = (const void**)OPENSSL_malloc(sizeof(void*) * SK_CHUNK)) == NULL)
+    {
+        return 0;
+    }
+    ch->spare = NULL;
+    ch->blk[ch->nblk] = blk;
+    ch->head[ch->nblk] = 0;
+    ch->nblk++;
+    return 1;
+}
+
+/* Moves the elements of |st->data| to blocks, returns 0 if out of memory */
+static int sk_chunkify(OPENSSL_STACK* st)
+{
+    SK_CHUNKS* ch;
+    int b, n;
+
+    if ((ch = (SK_CHUNKS*)OPENSSL_zalloc(sizeof(*ch))) == NULL)
+    {
+        return 0;
+    }
+    for (b = 0; b << OPENSSL_SK_CHUNK_BITS < st->num; b++)
+    {
+        if (!sk_chunks_add(ch))
+        {
+            sk_chunks_free(ch);
+            return 0;
+        }
+        n = st->num - (b << OPENSSL_SK_CHUNK_BITS);
+        memcpy((void*)ch->blk[b], (const void*)&st->data[b << OPENSSL_SK_CHUNK_BITS],
+               sizeof(void*) * (n < SK_CHUNK ? n : SK_CHUNK));
+    }
+    st->chunks = ch;
+    return 1;
+}
+
+/*
+* Inserts into a chunked stack whose |data| already has room for one more
+* element: the last element of each block after the target one moves to the
+* front of the next block, then the target block shifts its shorter side.
+* O(num / SK_CHUNK + SK_CHUNK).
+*/
+static int sk_chunk_insert(OPENSSL_STACK* st, const void* data, int loc)
+{
+    SK_CHUNKS* ch = st->chunks;
+    const void** blk;
+    int b, j, o, n, h, k;
+
+    if ((st->num & SK_CHUNK_MASK) == 0 && !sk_chunks_add(ch))
+    {
+        return 0;
+    }
+    b = loc >> OPENSSL_SK_CHUNK_BITS;
+    for (j = ch->nblk - 1; j > b; j--)
+    {
+        ch->head[j] = (ch->head[j] - 1) & SK_CHUNK_MASK;
+        ch->blk[j][ch->head[j]] =
+            ch->blk[j - 1][(ch->head[j - 1] + SK_CHUNK_MASK) & SK_CHUNK_MASK];
+    }
+    /* elements left in block |b| */
+    n = b < ch->nblk - 1 ? SK_CHUNK - 1
+        : st->num - (b << OPENSSL_SK_CHUNK_BITS);
+    o = loc & SK_CHUNK_MASK;
+    blk = ch->blk[b];
+    h = ch->head[b];
+    if (o < n / 2)
+    {
+        h = ch->head[b] = (h - 1) & SK_CHUNK_MASK;
+        for (k = 0; k < o; k++)
+        {
+            blk[(h + k) & SK_CHUNK_MASK] = blk[(h + k + 1) & SK_CHUNK_MASK];
+        }
+    }
+    else
+    {
+        for (k = n; k > o; k--)
+        {
+            blk[(h + k) & SK_CHUNK_MASK] = blk[(h + k - 1) & SK_CHUNK_MASK];
+        }
+    }
+    blk[(h + o) & SK_CHUNK_MASK] = data;
+    return 1;
+}
+
+/* The converse of sk_chunk_insert(), also O(num / SK_CHUNK + SK_CHUNK) */
+static const void* sk_chunk_delete(OPENSSL_STACK* st, int loc)
+{
+    SK_CHUNKS* ch = st->chunks;
+    const void** blk;
+    const void* ret;
+    int b, j, o, n, h, k;
+
+    b = loc >> OPENSSL_SK_CHUNK_BITS;
+    n = b < ch->nblk - 1 ? SK_CHUNK : st->num - (b << OPENSSL_SK_CHUNK_BITS);
+    o = loc & SK_CHUNK_MASK;
+    blk = ch->blk[b];
+    h = ch->head[b];
+    ret = blk[(h + o) & SK_CHUNK_MASK];
+    if (o < n / 2)
+    {
+        for (k = o; k > 0; k--)
+        {
+            blk[(h + k) & SK_CHUNK_MASK] = blk[(h + k - 1) & SK_CHUNK_MASK];
+        }
+        ch->head[b] = (h + 1) & SK_CHUNK_MASK;
+    }
+    else
+    {
+        for (k = o; k < n - 1; k++)
+        {
+            blk[(h + k) & SK_CHUNK_MASK] = blk[(h + k + 1) & SK_CHUNK_MASK];
+        }
+    }
+    for (j = b + 1; j < ch->nblk; j++)
+    {
+        ch->blk[j - 1][(ch->head[j - 1] + SK_CHUNK_MASK) & SK_CHUNK_MASK] =
+            ch->blk[j][ch->head[j]];
+        ch->head[j] = (ch->head[j] + 1) & SK_CHUNK_MASK;
+    }
+    if (((st->num - 1) & SK_CHUNK_MASK) == 0)
+    {
+        /* the last block is empty now */
+        ch->nblk--;
+        OPENSSL_free((void*)ch->spare);
+        ch->spare = ch->blk[ch->nblk];
+    }
+    return ret;
+}
+
+OPENSSL_sk_compfunc OPENSSL_sk_set_cmp_func(OPENSSL_STACK* sk, OPENSSL_sk_compfunc c)
+{
+    OPENSSL_sk_compfunc old = sk->comp;
+
+    if (sk_is_view(sk))
+    {
+        return old;
+    }
+    if (sk->comp != c)
+    {
+        sk->sorted = 0;
+        sk->gen++;
+    }
+    sk->comp = c;
+
+    return old;
+}
+
+OPENSSL_STACK* OPENSSL_sk_dup(const OPENSSL_STACK* sk)
+{
+    OPENSSL_STACK* ret;
+
+    if ((ret = sk_header_alloc()) == NULL)
+    {
+        //        CRYPTOerr(CRYPTO_F_OPENSSL_SK_DUP, ERR_R_MALLOC_FAILURE);
+        return NULL;
+    }
+
+    /* direct structure assignment */
+    *ret = *sk;
+    ret->scratch = NULL;
+    ret->scratch_alloc = 0;
+    ret->index = NULL;
+    ret->parent = NULL;
+    ret->view_owned = 0;
+    ret->chunks = NULL;
+    ret->embedded = 0;
+    SK_TRACE_DUP(ret, sk);
+
+    if (sk->num == 0)
+    {
+        /* postpone |ret->data| allocation */
+        ret->data = NULL;
+        ret->num_alloc = 0;
+        return ret;
+    }
+    /* duplicate |sk->data| content */
+    if ((ret->data = sk_data_alloc(sk->num_alloc, &ret->num_alloc)) == NULL)
+    {
+        goto err;
+    }
+    /* the copy starts out flat, chunked again by its first middle insert */
+    sk_copy_range(sk, 0, sk->num, ret->data);
+    return ret;
+err:
+    OPENSSL_sk_free(ret);
+    return NULL;
+}
+
+OPENSSL_STACK* OPENSSL_sk_deep_copy(const OPENSSL_STACK* sk,
+                                    OPENSSL_sk_copyfunc copy_func,
+                                    OPENSSL_sk_freefunc free_func)
+{
+    OPENSSL_STACK* ret;
+    const void* e;
+    int i;
+
+    if ((ret = sk_header_alloc()) == NULL)
+    {
+        //        CRYPTOerr(CRYPTO_F_OPENSSL_SK_DEEP_COPY, ERR_R_MALLOC_FAILURE);
+        return NULL;
+    }
+
+    /* direct structure assignment */
+    *ret = *sk;
+    ret->scratch = NULL;
+    ret->scratch_alloc = 0;
+    ret->index = NULL;
+    ret->parent = NULL;
+    ret->view_owned = 0;
+    ret->chunks = NULL;
+    ret->embedded = 0;
+    SK_TRACE_DUP(ret, sk);
+
+    if (sk->num == 0)
+    {
+        /* postpone |ret| data allocation */
+        ret->data = NULL;
+        ret->num_alloc = 0;
+        return ret;
+    }
+
+    ret->num_alloc = sk->num > min_nodes ? sk->num : min_nodes;
+    ret->data = (const void**)OPENSSL_zalloc(sizeof(*ret->data) * ret->num_alloc);
+    if (ret->data == NULL)
+    {
+        sk_header_release(ret);
+        return NULL;
+    }
+
+    for (i = 0; i < ret->num; ++i)
+    {
+        if ((e = *sk_slot(sk, i)) == NULL)
+        {
+            continue;
+        }
+        if ((ret->data[i] = copy_func(e)) == NULL)
+        {
+            while (--i >= 0)
+                if (ret->data[i] != NULL)
+                {
+                    free_func((void*)ret->data[i]);
+                }
+            OPENSSL_sk_free(ret);
+            return NULL;
+        }
+    }
+    return ret;
+}
+
+/*
+* Read-only view of the |len| elements of |st| from |start|.  It shares the
+* data of |st|, so taking one costs a (pooled) header and no copy.  Views
+* work with the accessors, iteration and the find functions, and are sorted
+* if |st| is; the functions that would change them fail instead.  A view
+* must not outlive |st|: free it before |st|.  |st| must not be changed
+* while the view is in use either, which debug builds check on each access
+* by comparing the generation of |st| with the one the view saw.  That
+* check reads |st|, so it catches a changed parent but not a freed one,
+* which is a use after free.  Release a view with OPENSSL_sk_free().  A
+* chunked |st| has no single range of slots to share, so a view of one (or
+* of such a view) holds a copy of its range.
+*/
+OPENSSL_STACK* OPENSSL_sk_view(const OPENSSL_STACK* st, int start, int len)
+{
+    OPENSSL_STACK* view;
+
+    if (st == NULL || start < 0 || len < 0 || start > st->num - len)
+    {
+        return NULL;
+    }
+    SK_VIEW_CHECK(st);
+    if ((view = sk_header_alloc()) == NULL)
+    {
+        return NULL;
+    }
+    view->num = len;
+    if (st->chunks != NULL || st->view_owned)
+    {
+        /* no single range of slots to look into */
+        if (len > 0
+            && (view->data = sk_data_alloc(len, &view->num_alloc)) == NULL)
+        {
+            sk_header_release(view);
+            return NULL;
+        }
+        sk_copy_range(st, start, len, view->data);
+        view->view_owned = 1;
+    }
+    else
+    {
+        view->data = st->data == NULL ? NULL : st->data + start;
+        view->num_alloc = len;
+    }
+    view->sorted = st->sorted;
+    view->comp = st->comp;
+    /* a view of a view looks into the original stack */
+    view->parent = sk_is_view(st) ? st->parent : st;
+    view->parent_gen = sk_is_view(st) ? st->parent_gen : st->gen;
+    return view;
+}
+
+int OPENSSL_sk_is_view(const OPENSSL_STACK* st)
+{
+    return st != NULL && sk_is_view(st);
+}
+
+OPENSSL_STACK* OPENSSL_sk_new_null(void)
+{
+    return OPENSSL_sk_new_reserve(NULL, 0);
+}
+
+OPENSSL_STACK* OPENSSL_sk_new(OPENSSL_sk_compfunc c)
+{
+    return OPENSSL_sk_new_reserve(c, 0);
+}
+
+/*
+* Calculate the array growth based on the target size.
+*
+* The growth fraction is a rational number and is defined by a numerator
+* and a denominator.  According to Andrew Koenig in his paper "Why Are
+* Vectors Efficient?" from JOOP 11(5) 1998, this factor should be less
+* than the golden ratio (1.618...).
+*
+* We use 3/2 = 1.5 for simplicity of calculation and overflow checking.
+* Another option 8/5 = 1.6 allows for slightly faster growth, although safe
+* computation is more difficult.
+*
+* The limit to avoid overflow is spot on.  The modulo three correction term
+* ensures that the limit is the largest number than can be expanded by the
+* growth factor without exceeding the hard limit.
+*
+* Do not call it with |current| lower than 2, or it will infinitely loop.
+*/
+static ossl_inline int compute_growth(int target, int current)
+{
+    const int limit = (max_nodes / 3) * 2 + (max_nodes % 3 ? 1 : 0);
+
+    while (current < target)
+    {
+        /* Check to see if we're at the hard limit */
+        if (current >= max_nodes)
+        {
+            return 0;
+        }
+
+        /* Expand the size by a factor of 3/2 if it is within range */
+        current = current < limit ? current + current / 2 : max_nodes;
+    }
+    return current;
+}
+
+/* internal STACK storage allocation */
+static int sk_reserve(OPENSSL_STACK* st, int n, int exact)
+{
+    const void** tmpdata;
+    int num_alloc;
+
+    /* Check to see the reservation isn't exceeding the hard limit */
+    if (n > max_nodes - st->num || sk_is_view(st))
+    {
+        return 0;
+    }
+
+    /* Figure out the new size */
+    num_alloc = st->num + n;
+    if (num_alloc < min_nodes)
+    {
+        num_alloc = min_nodes;
+    }
+
+    /* If |st->data| allocation was postponed */
+    if (st->data == NULL)
+    {
+        /*
+        * At this point, |st->num_alloc| and |st->num| are 0;
+        * so |num_alloc| value is |n| or |min_nodes| if greater than |n|.
+        */
+        if ((st->data = sk_data_alloc(num_alloc, &st->num_alloc)) == NULL)
+        {
+            //            CRYPTOerr(CRYPTO_F_SK_RESERVE, ERR_R_MALLOC_FAILURE);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (!exact)
+    {
+        if (num_alloc <= st->num_alloc)
+        {
+            return 1;
+        }
+        num_alloc = compute_growth(num_alloc, st->num_alloc);
+        if (num_alloc == 0)
+        {
+            return 0;
+        }
+    }
+    else if (num_alloc == st->num_alloc)
+    {
+        return 1;
+    }
+
+    tmpdata = (const void**)OPENSSL_realloc((void*)st->data, sizeof(void*) * num_alloc);
+    if (tmpdata == NULL)
+    {
+        return 0;
+    }
+
+    st->data = tmpdata;
+    st->num_alloc = num_alloc;
+    return 1;
+}
+
+OPENSSL_STACK* OPENSSL_sk_new_reserve(OPENSSL_sk_compfunc c, int n)
+{
+    OPENSSL_STACK* st = sk_header_alloc();
+
+    if (st == NULL)
+    {
+        return NULL;
+    }
+
+    st->comp = c;
+    SK_TRACE(NEW, st, n);
+
+    if (n <= 0)
+    {
+        return st;
+    }
+
+    if (!sk_reserve(st, n, 1))
+    {
+        OPENSSL_sk_free(st);
+        return NULL;
+    }
+
+    return st;
+}
+
+int OPENSSL_sk_reserve(OPENSSL_STACK* st, int n)
+{
+    if (st == NULL)
+    {
+        return 0;
+    }
+
+    if (n < 0)
+    {
+        return 1;
+    }
+    SK_TRACE(RESERVE, st, n);
+    return sk_reserve(st, n, 1);
+}
+
+int OPENSSL_sk_insert(OPENSSL_STACK* st, const void* data, int loc)
+{
+    int sorted;
+
+    if (st == NULL || st->num == max_nodes)
+    {
+        return 0;
+    }
+
+    if (!sk_reserve(st, 1, 0))
+    {
+        return 0;
+    }
+
+    if ((loc >= st->num) || (loc < 0))
+    {
+        loc = st->num;
+    }
+    SK_TRACE(INSERT, st, loc);
+    /* a chunked stack stays sorted if |data| goes between its neighbours */
+    sorted = st->chunked && st->sorted && st->comp != NULL
+             && (loc == 0 || st->comp(sk_slot(st, loc - 1), &data) <= 0)
+             && (loc == st->num || st->comp(&data, sk_slot(st, loc)) <= 0);
+    if (st->chunks == NULL && st->chunked && st->num >= SK_CHUNK_MIN_NUM
+        && loc < st->num)
+    {
+        /* without memory for the blocks, this insert simply moves the tail */
+        sk_chunkify(st);
+    }
+
+    if (st->chunks != NULL)
+    {
+        if (!sk_chunk_insert(st, data, loc))
+        {
+            return 0;
+        }
+    }
+    else if (loc == st->num)
+    {
+        st->data[st->num] = data;
+    }
+    else
+    {
+        memmove((void*)&st->data[loc + 1], (const void*)&st->data[loc],
+                sizeof(st->data[0]) * (st->num - loc));
+        st->data[loc] = data;
+    }
+    st->num++;
+    st->sorted = sorted;
+    st->gen++;
+    return st->num;
+}
+
+static ossl_inline void* internal_delete(OPENSSL_STACK* st, int loc)
+{
+    const void* ret;
+
+    SK_TRACE(DELETE, st, loc);
+    if (st->chunks == NULL && st->chunked && st->num >= SK_CHUNK_MIN_NUM
+        && loc < st->num - 1)
+    {
+        sk_chunkify(st);
+    }
+    if (st->chunks != NULL)
+    {
+        ret = sk_chunk_delete(st, loc);
+        st->num--;
+        st->gen++;
+        /* small enough again to be moved around in one piece */
+        if (st->num < SK_CHUNK_MIN_NUM / 2)
+        {
+            sk_flatten(st);
+        }
+        return (void*)ret;
+    }
+
+    ret = st->data[loc];
+    if (loc != st->num - 1)
+        memmove((void*)&st->data[loc], (const void*)&st->data[loc + 1],
+                sizeof(st->data[0]) * (st->num - loc - 1));
+    st->num--;
+    st->gen++;
+
+    return (void*)ret;
+}
+
+void* OPENSSL_sk_delete_ptr(OPENSSL_STACK* st, const void* p)
+{
+    int i;
+
+    if (sk_is_view(st))
+    {
+        return NULL;
+    }
+    for (i = 0; i < st->num; i++)
+        if (*sk_slot(st, i) == p)
+        {
+            return internal_delete(st, i);
+        }
+    return NULL;
+}
+
+void* OPENSSL_sk_delete(OPENSSL_STACK* st, int loc)
+{
+    if (st == NULL || loc < 0 || loc >= st->num || sk_is_view(st))
+    {
+        return NULL;
+    }
+
+    return internal_delete(st, loc);
+}
+
+/*
+* Whether |dst|, sorted, stays sorted once the sorted elements |src[0..n)|
+* are appended to it.
+*/
+static int sk_sorted_append(const OPENSSL_STACK* dst, const void** src,
+                            int n, int src_sorted, OPENSSL_sk_compfunc comp)
+{
+    if (n == 0)
+    {
+        return dst->sorted;
+    }
+    if (!src_sorted || comp != dst->comp)
+    {
+        return 0;
+    }
+    return dst->num == 0
+           || (dst->sorted && dst->comp(&dst->data[dst->num - 1], &src[0]) <= 0);
+}
+
+/*
+* Moves all the elements of |src| to the end of |dst|, leaving |src| empty.
+* When |dst| is empty the two buffers are simply exchanged, otherwise it is
+* one reservation and one copy.  Returns the new number of elements of
+* |dst|, or 0 on error.
+*/
+int OPENSSL_sk_concat(OPENSSL_STACK* dst, OPENSSL_STACK* src)
+{
+    const void** data;
+    int num_alloc, sorted;
+
+    if (dst == NULL || src == NULL || dst == src
+        || sk_is_view(dst) || sk_is_view(src))
+    {
+        return 0;
+    }
+    sk_flatten(dst);
+    sk_flatten(src);
+    sorted = sk_sorted_append(dst, src->data, src->num, src->sorted,
+                              src->comp);
+    if (dst->num == 0)
+    {
+        data = dst->data;
+        num_alloc = dst->num_alloc;
+        dst->data = src->data;
+        dst->num_alloc = src->num_alloc;
+        dst->num = src->num;
+        src->data = data;
+        src->num_alloc = num_alloc;
+    }
+    else if (src->num > 0)
+    {
+        if (!sk_reserve(dst, src->num, 0))
+        {
+            return 0;
+        }
+        memcpy((void*)&dst->data[dst->num], (const void*)src->data,
+               sizeof(*src->data) * src->num);
+        dst->num += src->num;
+    }
+    dst->sorted = sorted;
+    src->num = 0;
+    src->gen++;
+    dst->gen++;
+    return dst->num;
+}
+
+/*
+* Moves |count| elements of |src| from |from| (all the rest if |count| is
+* negative) to position |where| of |dst| (its end if |where| is out of
+* range, as for OPENSSL_sk_insert()).  Returns the new number of elements of
+* |dst|, or 0 on error.
+*/
+int OPENSSL_sk_splice(OPENSSL_STACK* dst, int where, OPENSSL_STACK* src,
+                      int from, int count)
+{
+    int sorted;
+
+    if (dst == NULL || src == NULL || dst == src
+        || sk_is_view(dst) || sk_is_view(src)
+        || from < 0 || from > src->num)
+    {
+        return 0;
+    }
+    if (count < 0 || count > src->num - from)
+    {
+        count = src->num - from;
+    }
+    if (count == 0)
+    {
+        return dst->num;
+    }
+    sk_flatten(dst);
+    sk_flatten(src);
+    if (!sk_reserve(dst, count, 0))
+    {
+        return 0;
+    }
+    if (where < 0 || where >= dst->num)
+    {
+        sorted = sk_sorted_append(dst, &src->data[from], count, src->sorted,
+                                  src->comp);
+        where = dst->num;
+    }
+    else
+    {
+        sorted = 0;
+        memmove((void*)&dst->data[where + count], (const void*)&dst->data[where],
+                sizeof(*dst->data) * (dst->num - where));
+    }
+    memcpy((void*)&dst->data[where], (const void*)&src->data[from],
+           sizeof(*src->data) * count);
+    dst->num += count;
+    dst->sorted = sorted;
+    dst->gen++;
+
+    memmove((void*)&src->data[from], (const void*)&src->data[from + count],
+            sizeof(*src->data) * (src->num - from - count));
+    src->num -= count;
+    src->gen++;
+    return dst->num;
+}
+
+/*
+* Exchanges the whole contents and settings of |a| and |b|.  Returns 0 if
+* either is a view.
+*/
+int OPENSSL_sk_swap(OPENSSL_STACK* a, OPENSSL_STACK* b)
+{
+    OPENSSL_STACK tmp;
+    unsigned int gen;
+
+    if (a == NULL || b == NULL || sk_is_view(a) || sk_is_view(b))
+    {
+        return 0;
+    }
+    /*
+    * Neither stack may end up with a generation one of its views saw, but
+    * the search indexes stay valid.
+    */
+    gen = (a->gen > b->gen ? a->gen : b->gen) + 1;
+    if (a->index != NULL && a->index->gen == a->gen)
+    {
+        a->index->gen = gen;
+    }
+    if (b->index != NULL && b->index->gen == b->gen)
+    {
+        b->index->gen = gen;
+    }
+    tmp = *a;
+    *a = *b;
+    *b = tmp;
+    /* a collector shard stays one, whatever its contents */
+    b->embedded = a->embedded;
+    a->embedded = tmp.embedded;
+    a->gen = b->gen = gen;
+    return 1;
+}
+
+/*
+* Takes the data buffer away from |st|, which is left empty and without
+* storage.  |*num| gets the number of elements; the buffer must be freed
+* with OPENSSL_free().  Returns NULL if |st| had no buffer.
+*/
+void** OPENSSL_sk_steal_array(OPENSSL_STACK* st, int* num)
+{
+    void** data;
+
+    if (num != NULL)
+    {
+        *num = 0;
+    }
+    if (st == NULL || sk_is_view(st))
+    {
+        return NULL;
+    }
+    sk_flatten(st);
+    data = (void**)st->data;
+    if (num != NULL)
+    {
+        *num = st->num;
+    }
+    st->data = NULL;
+    st->num = 0;
+    st->num_alloc = 0;
+    st->gen++;
+    return data;
+}
+
+/*
+* Makes a stack of the |num| elements of |data|, a buffer of |num_alloc|
+* pointers (|num| if smaller) allocated with OPENSSL_malloc(), which the
+* stack then owns.  On error NULL is returned and |data| stays the caller's.
+*/
+OPENSSL_STACK* OPENSSL_sk_from_array(OPENSSL_sk_compfunc c, void** data,
+                                     int num, int num_alloc)
+{
+    OPENSSL_STACK* st;
+
+    if (num < 0 || (data == NULL && num > 0))
+    {
+        return NULL;
+    }
+    if ((st = sk_header_alloc()) == NULL)
+    {
+        return NULL;
+    }
+    st->comp = c;
+    st->data = (const void**)data;
+    st->num = num;
+    st->num_alloc = data == NULL ? 0 : num_alloc < num ? num : num_alloc;
+    st->sorted = c != NULL && num < 2;
+    return st;
+}
+
+/*-
+* Stable sort: an adaptive merge sort in the spirit of timsort.  The input
+* is cut into natural runs (strictly descending ones are reversed in place),
+* runs shorter than SK_MINRUN are extended with binary insertion sort, and
+* neighbouring runs are then merged pairwise until one is left.  Each merge
+* first skips the prefix and suffix that are already in place, so presorted
+* and nearly sorted input costs close to a single linear pass.
+*/
+#define SK_MINRUN       32
+
+/* Inserts |a[start..hi)| into the sorted |a[lo..start)| */
+static void sk_binary_insertion(const void** a, int lo, int start, int hi,
+                                OPENSSL_sk_compfunc cmp)
+{
+    const void* x;
+    int l, h, m;
+
+    for (; start < hi; start++)
+    {
+        x = a[start];
+        l = lo;
+        h = start;
+        /* after equal elements, for stability */
+        while (l < h)
+        {
+            m = l + (h - l) / 2;
+            if (cmp(&x, &a[m]) < 0)
+            {
+                h = m;
+            }
+            else
+            {
+                l = m + 1;
+            }
+        }
+        memmove((void*)&a[l + 1], (const void*)&a[l], sizeof(*a) * (start - l));
+        a[l] = x;
+    }
+}
+
+/* Returns the end of the run starting at |lo|, which is left ascending */
+static int sk_count_run(const void** a, int lo, int hi,
+                        OPENSSL_sk_compfunc cmp)
+{
+    const void* t;
+    int i = lo + 1, j, k;
+
+    if (i == hi)
+    {
+        return hi;
+    }
+    /* only strictly descending runs are reversed, to keep stability */
+    if (cmp(&a[i], &a[lo]) < 0)
+    {
+        while (i + 1 < hi && cmp(&a[i + 1], &a[i]) < 0)
+        {
+            i++;
+        }
+        for (j = lo, k = i; j < k; j++, k--)
+        {
+            t = a[j];
+            a[j] = a[k];
+            a[k] = t;
+        }
+        return i + 1;
+    }
+    while (i + 1 < hi && cmp(&a[i + 1], &a[i]) >= 0)
+    {
+        i++;
+    }
+    return i + 1;
+}
+
+/* Merges the sorted |a[lo..mid)| and |a[mid..hi)| using |tmp| */
+static void sk_merge(const void** a, int lo, int mid, int hi,
+                     const void** tmp, OPENSSL_sk_compfunc cmp)
+{
+    int l, h, m, i, j, k, n;
+
+    /* left elements not greater than |a[mid]| are already in place */
+    l = lo;
+    h = mid;
+    while (l < h)
+    {
+        m = l + (h - l) / 2;
+        if (cmp(&a[mid], &a[m]) < 0)
+        {
+            h = m;
+        }
+        else
+        {
+            l = m + 1;
+        }
+    }
+    if (l == mid)
+    {
+        return;
+    }
+    lo = l;
+
+    /* and so are right elements not less than |a[mid - 1]| */
+    l = mid;
+    h = hi;
+    while (l < h)
+    {
+        m = l + (h - l) / 2;
+        if (cmp(&a[m], &a[mid - 1]) < 0)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            h = m;
+        }
+    }
+    hi = l;
+
+    n = mid - lo;
+    memcpy((void*)tmp, (const void*)&a[lo], sizeof(*a) * n);
+    for (i = 0, j = mid, k = lo; i < n && j < hi; k++)
+    {
+        if (cmp(&a[j], &tmp[i]) < 0)
+        {
+            a[k] = a[j++];
+        }
+        else
+        {
+            a[k] = tmp[i++];
+        }
+    }
+    memcpy((void*)&a[k], (const void*)&tmp[i], sizeof(*a) * (n - i));
+}
+
+static void internal_stable_sort(OPENSSL_STACK* st)
+{
+    const void** a = st->data;
+    const void** tmp;
+    OPENSSL_sk_compfunc cmp = st->comp;
+    int* runs;
+    int n = st->num, nruns, lo, hi, i, j;
+
+    if (n <= SK_MINRUN)
+    {
+        sk_binary_insertion(a, 0, 1, n, cmp);
+        return;
+    }
+    if (st->scratch_alloc < n)
+    {
+        tmp = (const void**)OPENSSL_realloc((void*)st->scratch, sizeof(*tmp) * n);
+        if (tmp != NULL)
+        {
+            st->scratch = tmp;
+            st->scratch_alloc = n;
+        }
+    }
+    /* every run but the last holds at least SK_MINRUN elements */
+    runs = (int*)OPENSSL_malloc(sizeof(*runs) * (n / SK_MINRUN + 2));
+    if (runs == NULL || st->scratch_alloc < n)
+    {
+        /* still stable, but quadratic */
+        OPENSSL_free(runs);
+        sk_binary_insertion(a, 0, 1, n, cmp);
+        return;
+    }
+
+    for (nruns = 0, lo = 0; lo < n; lo = hi)
+    {
+        hi = sk_count_run(a, lo, n, cmp);
+        if (hi - lo < SK_MINRUN)
+        {
+            j = n - lo < SK_MINRUN ? n : lo + SK_MINRUN;
+            sk_binary_insertion(a, lo, hi, j, cmp);
+            hi = j;
+        }
+        runs[nruns++] = lo;
+    }
+    runs[nruns] = n;
+
+    while (nruns > 1)
+    {
+        for (i = 0, j = 0; i < nruns; i += 2, j++)
+        {
+            if (i + 1 < nruns)
+            {
+                sk_merge(a, runs[i], runs[i + 1], runs[i + 2], st->scratch, cmp);
+            }
+            runs[j] = runs[i];
+        }
+        runs[j] = n;
+        nruns = j;
+    }
+    OPENSSL_free(runs);
+}
+
+static void sk_index_free(OPENSSL_STACK* st)
+{
+    if (st->index != NULL)
+    {
+        OPENSSL_free(st->index->seg);
+        OPENSSL_free(st->index);
+        st->index = NULL;
+    }
+}
+
+/*-
+* Learned index over a sorted stack with a key function: the positions of
+* the first element of each distinct key are covered by linear segments,
+* each predicting them to within OPENSSL_SK_INDEX_EPSILON.  Segments are
+* fitted greedily in one pass, as in FITing-tree and PGM: a segment keeps
+* the cone of slopes that satisfy all its points so far and ends at the
+* first point that would empty it.  Returns 0 on allocation failure or if
+* the keys are not in ascending order.
+*/
+static int sk_index_build(OPENSSL_STACK* st)
+{
+    const double eps = OPENSSL_SK_INDEX_EPSILON;
+    SK_INDEX* ix;
+    SK_INDEX_SEG* seg, *tmp;
+    double lo = 0, hi = 0, l, h, dk;
+    uint64_t k, prev = 0;
+    int i, nseg = 0, seg_alloc = 16, open = 0;
+
+    sk_index_free(st);
+    if (st->key == NULL)
+    {
+        return 0;
+    }
+    if ((ix = (SK_INDEX*)OPENSSL_zalloc(sizeof(*ix))) == NULL)
+    {
+        return 0;
+    }
+    if ((seg = (SK_INDEX_SEG*)OPENSSL_malloc(sizeof(*seg) * seg_alloc)) == NULL)
+    {
+        goto err;
+    }
+    for (i = 0; i < st->num; i++)
+    {
+        k = st->key(st->data[i]);
+        if (i > 0 && k <= prev)
+        {
+            if (k < prev)
+            {
+                goto err;
+            }
+            continue;
+        }
+        prev = k;
+        if (nseg > 0)
+        {
+            dk = (double)(k - seg[nseg - 1].key);
+            l = (i - seg[nseg - 1].pos - eps) / dk;
+            h = (i - seg[nseg - 1].pos + eps) / dk;
+            if (!open || (l <= hi && h >= lo))
+            {
+                lo = !open || l > lo ? l : lo;
+                hi = !open || h < hi ? h : hi;
+                open = 1;
+                continue;
+            }
+            seg[nseg - 1].slope = (lo + hi) / 2;
+        }
+        if (nseg == seg_alloc)
+        {
+            if (seg_alloc > INT_MAX / 2
+                || (tmp = (SK_INDEX_SEG*)OPENSSL_realloc(seg,
+                          sizeof(*seg) * seg_alloc * 2)) == NULL)
+            {
+                goto err;
+            }
+            seg = tmp;
+            seg_alloc *= 2;
+        }
+        seg[nseg].key = k;
+        seg[nseg].slope = 0;
+        seg[nseg].pos = i;
+        nseg++;
+        open = 0;
+    }
+    if (nseg > 0 && open)
+    {
+        seg[nseg - 1].slope = (lo + hi) / 2;
+    }
+    ix->gen = st->gen;
+    ix->nseg = nseg;
+    ix->seg = seg;
+    st->index = ix;
+    return 1;
+err:
+    /* keep an empty index so that finds do not retry for this generation */
+    OPENSSL_free(seg);
+    ix->gen = st->gen;
+    ix->nseg = 0;
+    ix->seg = NULL;
+    st->index = ix;
+    return 0;
+}
+
+/*
+* (Re)builds the index of a sorted stack if it has a key and none is valid.
+* Only the sorts, OPENSSL_sk_set_key_func() and an RCU commit call it: the
+* find functions never write to the stack, they binary search while the
+* index is stale, e.g. after a delete.
+*/
+static void sk_index_refresh(OPENSSL_STACK* st)
+{
+    if (st->key != NULL && st->num >= OPENSSL_SK_INDEX_MIN_NUM
+        && st->chunks == NULL
+        && (st->index == NULL || st->index->gen != st->gen))
+    {
+        sk_index_build(st);
+    }
+}
+
+/* Position the index predicts for the first element with key |k| */
+static int sk_index_predict(const SK_INDEX* ix, uint64_t k, int num)
+{
+    const SK_INDEX_SEG* s;
+    double p;
+    int lo = 0, hi = ix->nseg, mid, limit;
+
+    /* last segment starting at or before |k|, or the first one */
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (ix->seg[mid].key <= k)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    s = &ix->seg[lo];
+    if (k <= s->key)
+    {
+        return s->pos;
+    }
+    limit = lo + 1 < ix->nseg ? ix->seg[lo + 1].pos : num;
+    p = s->pos + s->slope * (double)(k - s->key);
+    if (p <= s->pos)
+    {
+        return s->pos;
+    }
+    return p >= limit ? limit : (int)p;
+}
+
+/*
+* Finds |data| through the index: a lower bound search for its key in the
+* window around the predicted position, checked against the neighbours of
+* the window, then a scan of the elements with that key.  Returns the index
+* of the first match, -1 if there is none, or -2 if the key fell outside
+* the window and a full search is needed.
+*/
+static int sk_index_find(const OPENSSL_STACK* st, const void* data)
+{
+    const int eps = OPENSSL_SK_INDEX_EPSILON;
+    uint64_t k = st->key(data);
+    int p, lo, hi, l, h, m, c;
+
+    p = sk_index_predict(st->index, k, st->num);
+    lo = p > eps ? p - eps - 1 : 0;
+    hi = st->num - p > eps + 2 ? p + eps + 2 : st->num;
+    l = lo;
+    h = hi;
+    while (l < h)
+    {
+        m = l + (h - l) / 2;
+        if (st->key(st->data[m]) < k)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            h = m;
+        }
+    }
+    if ((l == lo && lo > 0 && st->key(st->data[lo - 1]) >= k)
+        || (l == hi && hi < st->num && st->key(st->data[hi]) < k))
+    {
+        return -2;
+    }
+    for (; l < st->num && st->key(st->data[l]) == k; l++)
+    {
+        c = st->comp(&data, &st->data[l]);
+        if (c == 0)
+        {
+            return l;
+        }
+        if (c < 0)
+        {
+            break;
+        }
+    }
+    return -1;
+}
+
+/*
+* Sorts |st| with its comparison function unless it is already sorted.
+* Returns 0 if it is an unsorted view, which cannot be sorted in place.
+*/
+static int internal_sort(OPENSSL_STACK* st)
+{
+    if (!st->sorted)
+    {
+        if (sk_is_view(st))
+        {
+            return 0;
+        }
+        sk_flatten(st);
+        if (st->num > 1)
+        {
+            if (st->stable)
+            {
+                internal_stable_sort(st);
+            }
+            else
+            {
+                qsort((void*)st->data, st->num, sizeof(void*), st->comp);
+            }
+            st->gen++;
+        }
+        st->sorted = 1; /* empty or single-element stack is considered sorted */
+        sk_index_refresh(st);
+    }
+    return 1;
+}
+
+/* OBJ_bsearch_ex_() on the sorted chunked stack |st| */
+static int sk_chunk_bsearch(const OPENSSL_STACK* st, const void* data,
+                            int flags)
+{
+    int l = 0, h = st->num, i = 0, c = 0;
+
+    while (l < h)
+    {
+        i = (l + h) / 2;
+        c = st->comp(&data, sk_chunk_slot(st, i));
+        if (c < 0)
+        {
+            h = i;
+        }
+        else if (c > 0)
+        {
+            l = i + 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (c != 0)
+    {
+        return flags & OBJ_BSEARCH_VALUE_ON_NOMATCH ? i : -1;
+    }
+    if (flags & OBJ_BSEARCH_FIRST_VALUE_ON_MATCH)
+    {
+        while (i > 0 && st->comp(&data, sk_chunk_slot(st, i - 1)) == 0)
+        {
+            i--;
+        }
+    }
+    return i;
+}
+
+/*
+* internal_find() on a stack that is left as it is: a stack with a
+* comparison function is binary searched if sorted and scanned otherwise.
+*/
+static int sk_find_nosort(const OPENSSL_STACK* st, const void* data,
+                          int ret_val_options)
+{
+    const void* r;
+    int i;
+
+    if (st == NULL || st->num == 0)
+    {
+        return -1;
+    }
+
+    if (st->comp == NULL)
+    {
+        for (i = 0; i < st->num; i++)
+            if (*sk_slot(st, i) == data)
+            {
+                return i;
+            }
+        return -1;
+    }
+
+    if (!st->sorted)
+    {
+        /* first match by a linear scan */
+        for (i = 0; data != NULL && i < st->num; i++)
+            if (st->comp(&data, sk_slot(st, i)) == 0)
+            {
+                return i;
+            }
+        return -1;
+    }
+    if (data == NULL)
+    {
+        return -1;
+    }
+    if (st->chunks != NULL)
+    {
+        return sk_chunk_bsearch(st, data, ret_val_options);
+    }
+    if (st->index != NULL && st->index->gen == st->gen && st->index->nseg > 0
+        && (i = sk_index_find(st, data)) != -2
+        && (i >= 0 || !(ret_val_options & OBJ_BSEARCH_VALUE_ON_NOMATCH)))
+    {
+        return i;
+    }
+    r = OBJ_bsearch_ex_(&data, st->data, st->num, sizeof(void*), st->comp,
+                        ret_val_options);
+
+    return r == NULL ? -1 : (int)((const void**)r - st->data);
+}
+
+/* Sorts |st| if needed, except for a view, and finds |data| in it */
+static int internal_find(OPENSSL_STACK* st, const void* data,
+                         int ret_val_options)
+{
+    SK_VIEW_CHECK(st);
+    if (st != NULL && st->comp != NULL && st->num > 0)
+    {
+        internal_sort(st);
+    }
+    return sk_find_nosort(st, data, ret_val_options);
+}
+
+int OPENSSL_sk_find(OPENSSL_STACK* st, const void* data)
+{
+    int i = internal_find(st, data, OBJ_BSEARCH_FIRST_VALUE_ON_MATCH);
+
+    SK_TRACE(FIND, st, i);
+    return i;
+}
+
+int OPENSSL_sk_find_ex(OPENSSL_STACK* st, const void* data)
+{
+    int i = internal_find(st, data, OBJ_BSEARCH_VALUE_ON_NOMATCH);
+
+    SK_TRACE(FIND_EX, st, i);
+    return i;
+}
+
+/*
+* Binary search for the first element not less than (or, with |upper|,
+* greater than) |data| on the lazily sorted stack.  Returns a position in
+* [0, num], or -1 if the stack has no comparison function.
+*/
+static int internal_bound(OPENSSL_STACK* st, const void* data, int upper)
+{
+    int lo, hi, mid, c;
+
+    SK_VIEW_CHECK(st);
+    if (st == NULL || st->comp == NULL || data == NULL || !internal_sort(st))
+    {
+        return -1;
+    }
+
+    lo = 0;
+    hi = st->num;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        c = st->comp(sk_slot(st, mid), &data);
+        if (c < 0 || (upper && c == 0))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+* Index of the first element that does not compare less than |data|, i.e.
+* where it would be inserted to keep the stack sorted before any equal
+* elements.  The stack is sorted first if needed, as OPENSSL_sk_find()
+* does.  Returns the number of elements if all are less, -1 on error.
+*/
+int OPENSSL_sk_lower_bound(OPENSSL_STACK* st, const void* data)
+{
+    return internal_bound(st, data, 0);
+}
+
+/* As OPENSSL_sk_lower_bound(), for the first element greater than |data| */
+int OPENSSL_sk_upper_bound(OPENSSL_STACK* st, const void* data)
+{
+    return internal_bound(st, data, 1);
+}
+
+/*
+* Sets |*first| and |*last| to the half-open range of elements comparing
+* equal to |data| and returns its length, or -1 on error.  Two binary
+* searches, the second restricted to the elements after |*first|.
+*/
+int OPENSSL_sk_equal_range(OPENSSL_STACK* st, const void* data,
+                           int* first, int* last)
+{
+    int start, lo, hi, mid;
+
+    if ((start = internal_bound(st, data, 0)) < 0)
+    {
+        return -1;
+    }
+    lo = start;
+    hi = st->num;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (st->comp(sk_slot(st, mid), &data) <= 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (first != NULL)
+    {
+        *first = start;
+    }
+    if (last != NULL)
+    {
+        *last = lo;
+    }
+    return lo - start;
+}
+
+/* Number of elements comparing equal to |data|, in O(log n) */
+int OPENSSL_sk_count(OPENSSL_STACK* st, const void* data)
+{
+    return OPENSSL_sk_equal_range(st, data, NULL, NULL);
+}
+
+/*
+* A key of a find_many() batch with its position in the caller's array, and
+* the comparison function, as qsort() has no context argument
+*/
+typedef struct sk_batch_key_st
+{
+    const void* key;
+    int idx;
+    OPENSSL_sk_compfunc comp;
+} SK_BATCH_KEY;
+
+/* qsort() comparator for a find_many() batch: compares the keys */
+static int sk_batch_key_cmp(const void* a_, const void* b_)
+{
+    const SK_BATCH_KEY* a = (const SK_BATCH_KEY*)a_;
+    const SK_BATCH_KEY* b = (const SK_BATCH_KEY*)b_;
+
+    return a->comp(&a->key, &b->key);
+}
+
+/*
+* Lower bound of |key| in |data[pos..n)|, galloping from |pos|: the cost is
+* logarithmic in the distance travelled rather than in |n|.
+*/
+static int sk_gallop(const void** data, int pos, int n, const void* key,
+                     OPENSSL_sk_compfunc cmp)
+{
+    int lo = pos, hi, mid, step;
+
+    if (pos >= n || cmp(&data[pos], &key) >= 0)
+    {
+        return pos;
+    }
+    /* |data[lo]| < key from here on */
+    for (step = 1; lo + step < n && cmp(&data[lo + step], &key) < 0; step <<= 1)
+    {
+        lo += step;
+    }
+    hi = lo + step < n ? lo + step : n;
+    lo++;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (cmp(&data[mid], &key) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+* Looks up |nkeys| keys at once: |out_idx[i]| is set to what
+* OPENSSL_sk_find(st, keys[i]) returns.  The batch is put in order (unless
+* it already is) and resolved by one merge-like sweep of the sorted stack
+* that gallops from each match to the next, so a dense batch costs about
+* O(n + k) comparisons instead of O(k log n) scattered probes.  Returns the
+* number of keys found, or -1 on error.
+*/
+int OPENSSL_sk_find_many(OPENSSL_STACK* st, const void* const* keys,
+                         int nkeys, int* out_idx)
+{
+    SK_BATCH_KEY* batch = NULL;
+    OPENSSL_sk_compfunc cmp;
+    const void** data;
+    const void** tmp;
+    const void* key;
+    int i, pos, idx, found = 0, in_order = 1;
+
+    if (st == NULL || keys == NULL || out_idx == NULL || nkeys < 0)
+    {
+        return -1;
+    }
+    if (st->comp == NULL)
+    {
+        for (i = 0; i < nkeys; i++)
+            if ((out_idx[i] = internal_find(st, keys[i], 0)) >= 0)
+            {
+                found++;
+            }
+        return found;
+    }
+    cmp = st->comp;
+    if (!internal_sort(st) || !sk_read_array(st, &data, &tmp))
+    {
+        return -1;
+    }
+
+    for (i = 1; i < nkeys && in_order; i++)
+        if (keys[i - 1] == NULL || keys[i] == NULL
+            || cmp(&keys[i - 1], &keys[i]) > 0)
+        {
+            in_order = 0;
+        }
+    if (!in_order)
+    {
+        batch = (SK_BATCH_KEY*)OPENSSL_malloc(sizeof(*batch) * nkeys);
+        if (batch == NULL)
+        {
+            OPENSSL_free((void*)tmp);
+            return -1;
+        }
+        /* NULL keys are never found; keep them out of the comparator */
+        for (i = 0, idx = 0; i < nkeys; i++)
+        {
+            if (keys[i] == NULL)
+            {
+                out_idx[i] = -1;
+                continue;
+            }
+            batch[idx].key = keys[i];
+            batch[idx].comp = cmp;
+            batch[idx++].idx = i;
+        }
+        nkeys = idx;
+        qsort(batch, nkeys, sizeof(*batch), sk_batch_key_cmp);
+    }
+
+    for (i = 0, pos = 0; i < nkeys; i++)
+    {
+        key = batch != NULL ? batch[i].key : keys[i];
+        idx = batch != NULL ? batch[i].idx : i;
+        if (key == NULL)
+        {
+            out_idx[idx] = -1;
+            continue;
+        }
+        pos = sk_gallop(data, pos, st->num, key, cmp);
+        if (pos < st->num && cmp(&data[pos], &key) == 0)
+        {
+            out_idx[idx] = pos;
+            found++;
+        }
+        else
+        {
+            out_idx[idx] = -1;
+        }
+    }
+    OPENSSL_free(batch);
+    OPENSSL_free((void*)tmp);
+    return found;
+}
+
+/*-
+* Linear-time operations on two stacks sorted by the same comparison
+* function.  Both inputs are sorted first if needed; the output is a new
+* sorted stack sized once for the worst case.  Elements comparing equal are
+* matched one for one, as in the C++ std::set_* algorithms, and the copies
+* from |a| are preferred.
+*/
+#define SK_SET_MERGE            0
+#define SK_SET_UNION            1
+#define SK_SET_INTERSECTION     2
+#define SK_SET_DIFFERENCE       3
+
+static int sk_set_combine(const void** out, const void** a, int na,
+                          const void** b, int nb, OPENSSL_sk_compfunc cmp,
+                          int op)
+{
+    int i = 0, j = 0, k = 0, c;
+
+    while (i < na && j < nb)
+    {
+        c = cmp(&a[i], &b[j]);
+        if (op == SK_SET_MERGE)
+        {
+            /* ties go to |a|, which keeps the merge stable */
+            out[k++] = c <= 0 ? a[i++] : b[j++];
+        }
+        else if (c < 0)
+        {
+            if (op != SK_SET_INTERSECTION)
+            {
+                out[k++] = a[i];
+            }
+            i++;
+        }
+        else if (c > 0)
+        {
+            if (op == SK_SET_UNION)
+            {
+                out[k++] = b[j];
+            }
+            j++;
+        }
+        else
+        {
+            if (op != SK_SET_DIFFERENCE)
+            {
+                out[k++] = a[i];
+            }
+            i++;
+            j++;
+        }
+    }
+    if (op != SK_SET_INTERSECTION && i < na)
+    {
+        memcpy((void*)&out[k], (const void*)&a[i], sizeof(*out) * (na - i));
+        k += na - i;
+    }
+    if ((op == SK_SET_MERGE || op == SK_SET_UNION) && j < nb)
+    {
+        memcpy((void*)&out[k], (const void*)&b[j], sizeof(*out) * (nb - j));
+        k += nb - j;
+    }
+    return k;
+}
+
+static int sk_set_prepare(OPENSSL_STACK* a, OPENSSL_STACK* b)
+{
+    if (a == NULL || b == NULL || a->comp == NULL || a->comp != b->comp
+        || a->num > max_nodes - b->num)
+    {
+        return 0;
+    }
+    return internal_sort(a) && internal_sort(b);
+}
+
+static OPENSSL_STACK* sk_set_op(OPENSSL_STACK* a, OPENSSL_STACK* b, int op)
+{
+    OPENSSL_STACK* ret;
+    const void** da, ** db, ** ta, ** tb = NULL;
+    int n;
+
+    if (!sk_set_prepare(a, b) || !sk_read_array(a, &da, &ta))
+    {
+        return NULL;
+    }
+    if (!sk_read_array(b, &db, &tb))
+    {
+        OPENSSL_free((void*)ta);
+        return NULL;
+    }
+    switch (op)
+    {
+    case SK_SET_INTERSECTION:
+        n = a->num < b->num ? a->num : b->num;
+        break;
+    case SK_SET_DIFFERENCE:
+        n = a->num;
+        break;
+    default:
+        n = a->num + b->num;
+        break;
+    }
+    if ((ret = OPENSSL_sk_new_reserve(a->comp, n)) != NULL)
+    {
+        if (n > 0)
+        {
+            ret->num = sk_set_combine(ret->data, da, a->num, db, b->num,
+                                      a->comp, op);
+        }
+        ret->sorted = 1;
+    }
+    OPENSSL_free((void*)ta);
+    OPENSSL_free((void*)tb);
+    return ret;
+}
+
+/* All elements of |a| and |b| in order; a stable merge */
+OPENSSL_STACK* OPENSSL_sk_merge(OPENSSL_STACK* a, OPENSSL_STACK* b)
+{
+    return sk_set_op(a, b, SK_SET_MERGE);
+}
+
+OPENSSL_STACK* OPENSSL_sk_set_union(OPENSSL_STACK* a, OPENSSL_STACK* b)
+{
+    return sk_set_op(a, b, SK_SET_UNION);
+}
+
+OPENSSL_STACK* OPENSSL_sk_set_intersection(OPENSSL_STACK* a,
+        OPENSSL_STACK* b)
+{
+    return sk_set_op(a, b, SK_SET_INTERSECTION);
+}
+
+/* Elements of |a| without a matching element in |b| */
+OPENSSL_STACK* OPENSSL_sk_set_difference(OPENSSL_STACK* a, OPENSSL_STACK* b)
+{
+    return sk_set_op(a, b, SK_SET_DIFFERENCE);
+}
+
+/*
+* Replaces the contents of |dst| by its union with |src|, which is left
+* unchanged: one new buffer is filled in a single pass and swapped in.
+* Returns the new number of elements of |dst|, or -1 on error, in which case
+* |dst| is untouched apart from being sorted.
+*/
+int OPENSSL_sk_set_union_into(OPENSSL_STACK* dst, OPENSSL_STACK* src)
+{
+    const void** data, ** sdata, ** tmp;
+    int n, num_alloc;
+
+    if (dst == NULL || sk_is_view(dst) || !sk_set_prepare(dst, src))
+    {
+        return -1;
+    }
+    if (src->num == 0)
+    {
+        return dst->num;
+    }
+    n = dst->num + src->num;
+    if (n < min_nodes)
+    {
+        n = min_nodes;
+    }
+    if (!sk_read_array(src, &sdata, &tmp))
+    {
+        return -1;
+    }
+    if ((data = sk_data_alloc(n, &num_alloc)) == NULL)
+    {
+        OPENSSL_free((void*)tmp);
+        return -1;
+    }
+    sk_flatten(dst);
+    dst->num = sk_set_combine(data, dst->data, dst->num, sdata, src->num,
+                              dst->comp, SK_SET_UNION);
+    OPENSSL_free((void*)tmp);
+    sk_data_release(dst->data, dst->num_alloc);
+    dst->data = data;
+    dst->num_alloc = num_alloc;
+    dst->sorted = 1;
+    dst->gen++;
+    return dst->num;
+}
+
+int OPENSSL_sk_push(OPENSSL_STACK* st, const void* data)
+{
+    if (st == NULL)
+    {
+        return -1;
+    }
+    return OPENSSL_sk_insert(st, data, st->num);
+}
+
+int OPENSSL_sk_unshift(OPENSSL_STACK* st, const void* data)
+{
+    return OPENSSL_sk_insert(st, data, 0);
+}
+
+void* OPENSSL_sk_shift(OPENSSL_STACK* st)
+{
+    if (st == NULL || st->num == 0 || sk_is_view(st))
+    {
+        return NULL;
+    }
+    return internal_delete(st, 0);
+}
+
+void* OPENSSL_sk_pop(OPENSSL_STACK* st)
+{
+    if (st == NULL || st->num == 0 || sk_is_view(st))
+    {
+        return NULL;
+    }
+    return internal_delete(st, st->num - 1);
+}
+
+void OPENSSL_sk_zero(OPENSSL_STACK* st)
+{
+    SK_TRACE(ZERO, st, 0);
+    if (st == NULL || st->num == 0 || sk_is_view(st))
+    {
+        return;
+    }
+    sk_flatten(st);
+    memset((void*)st->data, 0, sizeof(*st->data) * st->num);
+    st->num = 0;
+    st->gen++;
+}
+
+/* Like OPENSSL_sk_zero() but leaves the old pointers in the unused slots */
+void OPENSSL_sk_clear(OPENSSL_STACK* st)
+{
+    SK_TRACE(ZERO, st, 0);
+    if (st == NULL || st->num == 0 || sk_is_view(st))
+    {
+        return;
+    }
+    if (st->chunks != NULL)
+    {
+        sk_chunks_free(st->chunks);
+        st->chunks = NULL;
+    }
+    st->num = 0;
+    st->gen++;
+}
+
+static int sk_prefetch_distance(int num, int distance)
+{
+    if (distance == OPENSSL_SK_PREFETCH_AUTO)
+    {
+        return num < OPENSSL_SK_PREFETCH_MIN_NUM ? 0
+               : OPENSSL_SK_PREFETCH_DISTANCE;
+    }
+    return distance < 0 ? 0 : distance;
+}
+
+void OPENSSL_sk_pop_free(OPENSSL_STACK* st, OPENSSL_sk_freefunc func)
+{
+    int i, d;
+
+    if (st == NULL)
+    {
+        return;
+    }
+    if (sk_is_view(st))
+    {
+        /* the elements belong to the parent */
+        OPENSSL_sk_free(st);
+        return;
+    }
+    sk_flatten(st);
+    /* |func| usually touches the object, so fetch the ones coming up */
+    d = sk_prefetch_distance(st->num, OPENSSL_SK_PREFETCH_AUTO);
+    for (i = 0; i < st->num; i++)
+    {
+        if (i + d < st->num && d > 0)
+        {
+            sk_prefetch_elem(st->data[i + d], OPENSSL_SK_PREFETCH_NOFIELD);
+        }
+        if (st->data[i] != NULL)
+        {
+            func((char*)st->data[i]);
+        }
+    }
+    OPENSSL_sk_free(st);
+}
+
+void OPENSSL_sk_free(OPENSSL_STACK* st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    /* collector shards are freed with their collector only */
+    assert(!st->embedded);
+    SK_TRACE(FREE, st, 0);
+    if (!sk_is_view(st) || st->view_owned)
+    {
+        sk_data_release(st->data, st->num_alloc);
+    }
+    if (st->chunks != NULL)
+    {
+        sk_chunks_free(st->chunks);
+    }
+    OPENSSL_free((void*)st->scratch);
+    sk_index_free(st);
+    sk_header_release(st);
+}
+
+int OPENSSL_sk_num(const OPENSSL_STACK* st)
+{
+    SK_VIEW_CHECK(st);
+    SK_TRACE(NUM, st, 0);
+    return st == NULL ? -1 : st->num;
+}
+
+void* OPENSSL_sk_value(const OPENSSL_STACK* st, int i)
+{
+    SK_VIEW_CHECK(st);
+    if (st == NULL || i < 0 || i >= st->num)
+    {
+        return NULL;
+    }
+    SK_TRACE(VALUE, st, i);
+    return (void*)*sk_slot(st, i);
+}
+
+void* OPENSSL_sk_set(OPENSSL_STACK* st, int i, const void* data)
+{
+    if (st == NULL || i < 0 || i >= st->num || sk_is_view(st))
+    {
+        return NULL;
+    }
+    SK_TRACE(SET, st, i);
+    *sk_slot(st, i) = data;
+    st->sorted = 0;
+    st->gen++;
+    return (void*)data;
+}
+
+void OPENSSL_sk_sort(OPENSSL_STACK* st)
+{
+    SK_TRACE(SORT, st, 0);
+    if (st != NULL && st->comp != NULL)
+    {
+        internal_sort(st);
+        sk_index_refresh(st);
+    }
+}
+
+/*
+* Sorts |st| keeping elements that compare equal in their current order, so
+* that OPENSSL_sk_find() then returns the earliest inserted match.
+*/
+void OPENSSL_sk_stable_sort(OPENSSL_STACK* st)
+{
+    SK_TRACE(SORT, st, 0);
+    if (st != NULL && st->comp != NULL && !st->sorted && !sk_is_view(st))
+    {
+        sk_flatten(st);
+        if (st->num > 1)
+        {
+            internal_stable_sort(st);
+            st->gen++;
+        }
+        st->sorted = 1;
+        sk_index_refresh(st);
+    }
+}
+
+/*
+* Makes OPENSSL_sk_sort() and the lazy sort done by the find functions
+* stable on |st| (if |stable| is non-zero).  Returns the previous setting.
+*/
+int OPENSSL_sk_set_stable(OPENSSL_STACK* st, int stable)
+{
+    int old;
+
+    if (st == NULL)
+    {
+        return 0;
+    }
+    old = st->stable;
+    st->stable = stable != 0;
+    return old;
+}
+
+/*
+* Chunked mode, for large stacks with many inserts and deletes away from
+* the end: from SK_CHUNK_MIN_NUM elements on, the elements move to a tiered
+* vector of fixed-size blocks, where those cost O(sqrt(n)) instead of O(n)
+* and OPENSSL_sk_value() stays O(1).  An insert into a sorted chunked stack
+* that keeps the order, e.g. at OPENSSL_sk_lower_bound(), keeps it sorted,
+* so finds keep binary searching the blocks.  Everything else works as usual
+* but moves the elements back into one array first, which costs O(n) once.
+* |data| stays allocated meanwhile, so the stack uses up to twice the
+* memory.  Returns the previous setting, or -1 for a view.
+*/
+int OPENSSL_sk_set_chunked(OPENSSL_STACK* st, int chunked)
+{
+    int old;
+
+    if (st == NULL || sk_is_view(st))
+    {
+        return -1;
+    }
+    old = st->chunked;
+    st->chunked = chunked != 0;
+    if (!st->chunked)
+    {
+        sk_flatten(st);
+    }
+    return old;
+}
+
+/*
+* Gives |st| a numeric key for its search index: sorting a stack of at
+* least OPENSSL_SK_INDEX_MIN_NUM elements, or OPENSSL_sk_build_index(), then
+* fits a model of where each key sits so that the find functions probe a
+* few neighbouring elements instead of binary searching the whole stack.
+* The key order must agree with the comparison function: if an element
+* compares less than another, its key is not greater.  The index of a
+* sorted stack is built here.  Any change of the stack invalidates it, and
+* the find functions binary search until the next sort rebuilds it.
+* Returns the previous key function.
+*/
+OPENSSL_sk_keyfunc OPENSSL_sk_set_key_func(OPENSSL_STACK* st,
+        OPENSSL_sk_keyfunc key)
+{
+    OPENSSL_sk_keyfunc old;
+
+    if (st == NULL)
+    {
+        return NULL;
+    }
+    old = st->key;
+    st->key = key;
+    sk_index_free(st);
+    if (st->sorted && st->comp != NULL && !sk_is_view(st))
+    {
+        sk_index_refresh(st);
+    }
+    return old;
+}
+
+/*
+* Sorts |st| if needed and builds its search index whatever its size, e.g.
+* once a lookup table is complete.  Returns 1 if the index is in place.
+*/
+int OPENSSL_sk_build_index(OPENSSL_STACK* st)
+{
+    if (st == NULL || st->comp == NULL || st->key == NULL || sk_is_view(st))
+    {
+        return 0;
+    }
+    internal_sort(st);
+    sk_flatten(st);
+    if (st->index != NULL && st->index->gen == st->gen
+        && st->index->nseg > 0)
+    {
+        return 1;
+    }
+    return sk_index_build(st);
+}
+
+/* Max-heap on |h[0..n)| ordered by |cmp|: restores the heap below |i| */
+static void sk_maxheap_sift(const void** h, int i, int n,
+                            OPENSSL_sk_compfunc cmp)
+{
+    const void* x = h[i];
+    int c;
+
+    while ((c = 2 * i + 1) < n)
+    {
+        if (c + 1 < n && cmp(&h[c], &h[c + 1]) < 0)
+        {
+            c++;
+        }
+        if (cmp(&x, &h[c]) >= 0)
+        {
+            break;
+        }
+        h[i] = h[c];
+        i = c;
+    }
+    h[i] = x;
+}
+
+/*
+* Heap-select: moves the |m| smallest elements of |a[0..n)| to |a[0..m)|,
+* as a max-heap, in O(n log m).
+*/
+static void sk_heap_select(const void** a, int m, int n,
+                           OPENSSL_sk_compfunc cmp)
+{
+    const void* t;
+    int i;
+
+    for (i = m / 2 - 1; i >= 0; i--)
+    {
+        sk_maxheap_sift(a, i, m, cmp);
+    }
+    for (i = m; i < n; i++)
+    {
+        if (cmp(&a[i], &a[0]) < 0)
+        {
+            t = a[0];
+            a[0] = a[i];
+            a[i] = t;
+            sk_maxheap_sift(a, 0, m, cmp);
+        }
+    }
+}
+
+/* Turns the max-heap |h[0..n)| into an ascending array */
+static void sk_heap_sort(const void** h, int n, OPENSSL_sk_compfunc cmp)
+{
+    const void* t;
+
+    while (n > 1)
+    {
+        t = h[0];
+        h[0] = h[--n];
+        h[n] = t;
+        sk_maxheap_sift(h, 0, n, cmp);
+    }
+}
+
+/*
+* Introselect: quickselect with median-of-three pivots that falls back to
+* heap-select once it has recursed 2*log2(n) times, so that the worst case
+* stays O(n log n).  Leaves |a[nth]| where a full sort would put it, with
+* no greater element before it and no smaller one after it.
+*/
+static void sk_introselect(const void** a, int lo, int hi, int nth,
+                           OPENSSL_sk_compfunc cmp)
+{
+    const void* p, *t;
+    int i, j, mid, depth;
+
+    for (depth = 0, i = hi - lo; i > 1; i >>= 1)
+    {
+        depth += 2;
+    }
+    while (hi - lo > 16)
+    {
+        if (depth-- == 0)
+        {
+            sk_heap_select(a + lo, nth - lo + 1, hi - lo, cmp);
+            t = a[lo];
+            a[lo] = a[nth];
+            a[nth] = t;
+            return;
+        }
+
+        /* median of three goes to |a[lo]| and is the pivot */
+        mid = lo + (hi - lo) / 2;
+        if (cmp(&a[mid], &a[lo]) < 0)
+        {
+            t = a[mid];
+            a[mid] = a[lo];
+            a[lo] = t;
+        }
+        if (cmp(&a[hi - 1], &a[mid]) < 0)
+        {
+            t = a[hi - 1];
+            a[hi - 1] = a[mid];
+            a[mid] = t;
+            if (cmp(&a[mid], &a[lo]) < 0)
+            {
+                t = a[mid];
+                a[mid] = a[lo];
+                a[lo] = t;
+            }
+        }
+        t = a[mid];
+        a[mid] = a[lo];
+        a[lo] = t;
+        p = a[lo];
+
+        /* Hoare partition: |a[lo..j]| <= p <= |a[j+1..hi)| */
+        i = lo - 1;
+        j = hi;
+        for (;;)
+        {
+            do
+            {
+                i++;
+            }
+            while (cmp(&a[i], &p) < 0);
+            do
+            {
+                j--;
+            }
+            while (cmp(&p, &a[j]) < 0);
+            if (i >= j)
+            {
+                break;
+            }
+            t = a[i];
+            a[i] = a[j];
+            a[j] = t;
+        }
+        if (nth <= j)
+        {
+            hi = j + 1;
+        }
+        else
+        {
+            lo = j + 1;
+        }
+    }
+    sk_binary_insertion(a, lo, lo + 1, hi, cmp);
+}
+
+/*
+* Partially orders |st| so that element |nth| is the one a full sort would
+* put there, with no greater element before it and no smaller one after it,
+* in expected linear time.  The stack is left unsorted unless it already
+* was.  Returns 0 if |st| has no comparison function or |nth| is out of
+* range.
+*/
+int OPENSSL_sk_nth_element(OPENSSL_STACK* st, int nth)
+{
+    if (st == NULL || st->comp == NULL || nth < 0 || nth >= st->num
+        || sk_is_view(st))
+    {
+        return 0;
+    }
+    if (!st->sorted)
+    {
+        sk_flatten(st);
+        sk_introselect(st->data, 0, st->num, nth, st->comp);
+        st->gen++;
+    }
+    return 1;
+}
+
+/*
+* Puts the |k| smallest elements in order at the start of |st|, in
+* O(n log k); the order of the remaining ones is unspecified.  With |k| at
+* least the number of elements this is OPENSSL_sk_sort(), which marks the
+* stack sorted; otherwise it is left unsorted.
+*/
+int OPENSSL_sk_partial_sort(OPENSSL_STACK* st, int k)
+{
+    if (st == NULL || st->comp == NULL || k < 0 || sk_is_view(st))
+    {
+        return 0;
+    }
+    if (k >= st->num)
+    {
+        internal_sort(st);
+        return 1;
+    }
+    if (!st->sorted && k > 0)
+    {
+        sk_flatten(st);
+        sk_heap_select(st->data, k, st->num, st->comp);
+        sk_heap_sort(st->data, k, st->comp);
+        st->gen++;
+    }
+    return 1;
+}
+
+/*
+* Pushes the |k| smallest elements of |st| onto |out| in ascending order,
+* leaving |st| itself untouched.  |out| is marked sorted if it was empty and
+* shares the comparison function of |st|.  Returns the number of elements
+* pushed, or -1 on error.
+*/
+int OPENSSL_sk_top_k(const OPENSSL_STACK* st, int k, OPENSSL_STACK* out)
+{
+    const void** h;
+    int i, was_empty;
+
+    if (st == NULL || out == NULL || st->comp == NULL || k < 0)
+    {
+        return -1;
+    }
+    if (k > st->num)
+    {
+        k = st->num;
+    }
+    if (k == 0)
+    {
+        return 0;
+    }
+    sk_flatten(out);
+    if (!sk_reserve(out, k, 0))
+    {
+        return -1;
+    }
+    was_empty = out->num == 0;
+
+    h = out->data + out->num;
+    sk_copy_range(st, 0, k, h);
+    if (!st->sorted)
+    {
+        /* heap-select in place at the end of |out|, from a copy of |st| */
+        for (i = k / 2 - 1; i >= 0; i--)
+        {
+            sk_maxheap_sift(h, i, k, st->comp);
+        }
+        for (i = k; i < st->num; i++)
+        {
+            if (st->comp(sk_slot(st, i), &h[0]) < 0)
+            {
+                h[0] = *sk_slot(st, i);
+                sk_maxheap_sift(h, 0, k, st->comp);
+            }
+        }
+        sk_heap_sort(h, k, st->comp);
+    }
+    out->num += k;
+    out->sorted = was_empty && out->comp == st->comp;
+    out->gen++;
+    return k;
+}
+
+/*-
+* Priority-queue mode: the OPENSSL_sk_heap_* functions keep |st->data| as a
+* min-heap ordered by the comparison function, with the smallest element at
+* index 0.  The heap is binary unless OPENSSL_sk_set_heap_arity() asks for a
+* 4-ary one, which is shallower and touches fewer cache lines per sift.
+* A sorted stack is a valid heap, but heap operations clear the sorted flag.
+*/
+static ossl_inline int sk_heap_d(const OPENSSL_STACK* st)
+{
+    return st->heap_arity == 4 ? 4 : 2;
+}
+
+/* Moves |h[i]| towards the top of the heap, returns its new index */
+static int sk_heap_up(const void** h, int i, int d, OPENSSL_sk_compfunc cmp)
+{
+    const void* x = h[i];
+    int p;
+
+    while (i > 0)
+    {
+        p = (i - 1) / d;
+        if (cmp(&x, &h[p]) >= 0)
+        {
+            break;
+        }
+        h[i] = h[p];
+        i = p;
+    }
+    h[i] = x;
+    return i;
+}
+
+/* Moves |h[i]| towards the bottom of the heap |h[0..n)|, returns its index */
+static int sk_heap_down(const void** h, int i, int n, int d,
+                        OPENSSL_sk_compfunc cmp)
+{
+    const void* x = h[i];
+    int c, m, last;
+
+    /* |i| has children while d * i + 1 < n, written not to overflow */
+    while (n > 1 && i <= (n - 2) / d)
+    {
+        m = c = d * i + 1;
+        last = n - c > d ? c + d : n;
+        for (c++; c < last; c++)
+        {
+            if (cmp(&h[c], &h[m]) < 0)
+            {
+                m = c;
+            }
+        }
+        if (cmp(&h[m], &x) >= 0)
+        {
+            break;
+        }
+        h[i] = h[m];
+        i = m;
+    }
+    h[i] = x;
+    return i;
+}
+
+/*
+* Selects a binary (|arity| 2) or 4-ary heap.  An existing heap must be
+* rebuilt with OPENSSL_sk_heapify() after a change.  Returns the previous
+* arity, or 0 if |arity| is not supported.
+*/
+int OPENSSL_sk_set_heap_arity(OPENSSL_STACK* st, int arity)
+{
+    int old;
+
+    if (st == NULL || (arity != 2 && arity != 4))
+    {
+        return 0;
+    }
+    old = sk_heap_d(st);
+    st->heap_arity = arity;
+    return old;
+}
+
+/* Builds a heap from the current elements in O(n).  Returns 0 on error */
+int OPENSSL_sk_heapify(OPENSSL_STACK* st)
+{
+    int i, d;
+
+    if (st == NULL || st->comp == NULL || sk_is_view(st))
+    {
+        return 0;
+    }
+    if (st->sorted || st->num < 2)
+    {
+        return 1;
+    }
+    sk_flatten(st);
+    d = sk_heap_d(st);
+    for (i = (st->num - 2) / d; i >= 0; i--)
+    {
+        sk_heap_down(st->data, i, st->num, d, st->comp);
+    }
+    st->gen++;
+    return 1;
+}
+
+/* Adds |data| to the heap in O(log n).  Returns the new size, or 0 on error */
+int OPENSSL_sk_heap_push(OPENSSL_STACK* st, const void* data)
+{
+    if (st == NULL || st->comp == NULL || !sk_reserve(st, 1, 0))
+    {
+        return 0;
+    }
+    sk_flatten(st);
+    st->data[st->num] = data;
+    sk_heap_up(st->data, st->num++, sk_heap_d(st), st->comp);
+    st->sorted = 0;
+    st->gen++;
+    return st->num;
+}
+
+/* The smallest element, or NULL if the heap is empty */
+void* OPENSSL_sk_heap_top(const OPENSSL_STACK* st)
+{
+    if (st == NULL || st->num <= 0)
+    {
+        return NULL;
+    }
+    return (void*)*sk_slot(st, 0);
+}
+
+/*
+* Removes the element at |idx| in O(log n) by moving the last element into
+* its slot and sifting that in whichever direction is needed.
+*/
+void* OPENSSL_sk_heap_delete(OPENSSL_STACK* st, int idx)
+{
+    const void* ret;
+
+    if (st == NULL || st->comp == NULL || idx < 0 || idx >= st->num
+        || sk_is_view(st))
+    {
+        return NULL;
+    }
+    sk_flatten(st);
+    ret = st->data[idx];
+    if (idx != --st->num)
+    {
+        st->data[idx] = st->data[st->num];
+        OPENSSL_sk_heap_update(st, idx);
+    }
+    st->gen++;
+    return (void*)ret;
+}
+
+/* Removes and returns the smallest element in O(log n) */
+void* OPENSSL_sk_heap_pop(OPENSSL_STACK* st)
+{
+    return OPENSSL_sk_heap_delete(st, 0);
+}
+
+/*
+* Restores the heap after the key of the element at |idx| changed: a
+* decrease-key moves it up, an increase moves it down.  Returns the new index
+* of the element, or -1 on error.
+*/
+int OPENSSL_sk_heap_update(OPENSSL_STACK* st, int idx)
+{
+    int d, i;
+
+    if (st == NULL || st->comp == NULL || idx < 0 || idx >= st->num
+        || sk_is_view(st))
+    {
+        return -1;
+    }
+    sk_flatten(st);
+    d = sk_heap_d(st);
+    i = sk_heap_up(st->data, idx, d, st->comp);
+    if (i == idx)
+    {
+        i = sk_heap_down(st->data, idx, st->num, d, st->comp);
+    }
+    st->sorted = 0;
+    st->gen++;
+    return i;
+}
+
+#define SK_RADIX_BITS   8
+#define SK_RADIX_SIZE   (1 << SK_RADIX_BITS)
+
+/*
+* Sorts |st| in ascending order of |key(element)|, looking at the low
+* |key_bits| bits of the key only (all 64 if |key_bits| is out of range).
+* This is a stable LSD radix sort, one pass per byte of key, in linear time;
+* passes over bytes that are the same for every key are skipped.  The stack
+* is marked sorted, so the key order must agree with the comparison function
+* for the find functions to keep working.  Returns 0 on allocation failure,
+* leaving the stack untouched.
+*/
+int OPENSSL_sk_radix_sort(OPENSSL_STACK* st, OPENSSL_sk_keyfunc key,
+                          int key_bits)
+{
+    size_t (*count)[SK_RADIX_SIZE];
+    uint64_t* keys, *kin, *kout, *kt;
+    const void** pin, **pout, **pt;
+    size_t pos, c;
+    int i, d, digits, n, t;
+
+    if (st == NULL || key == NULL || sk_is_view(st))
+    {
+        return 0;
+    }
+    sk_flatten(st);
+    n = st->num;
+    if (n < 2)
+    {
+        st->sorted = 1;
+        return 1;
+    }
+    if (key_bits <= 0 || key_bits > 64)
+    {
+        key_bits = 64;
+    }
+    digits = (key_bits + SK_RADIX_BITS - 1) / SK_RADIX_BITS;
+
+    if (st->scratch_alloc < n)
+    {
+        pt = (const void**)OPENSSL_realloc((void*)st->scratch, sizeof(*pt) * n);
+        if (pt == NULL)
+        {
+            return 0;
+        }
+        st->scratch = pt;
+        st->scratch_alloc = n;
+    }
+    keys = (uint64_t*)OPENSSL_malloc(sizeof(*keys) * 2 * n);
+    count = (size_t(*)[SK_RADIX_SIZE])OPENSSL_zalloc(sizeof(*count) * digits);
+    if (keys == NULL || count == NULL)
+    {
+        OPENSSL_free(keys);
+        OPENSSL_free(count);
+        return 0;
+    }
+
+    /* extract the keys once and build every digit's histogram as we go */
+    for (i = 0; i < n; i++)
+    {
+        keys[i] = key(st->data[i]);
+        if (key_bits < 64)
+        {
+            keys[i] &= ((uint64_t)1 << key_bits) - 1;
+        }
+        for (d = 0; d < digits; d++)
+        {
+            count[d][(keys[i] >> (d * SK_RADIX_BITS)) & (SK_RADIX_SIZE - 1)]++;
+        }
+    }
+
+    kin = keys;
+    kout = keys + n;
+    pin = st->data;
+    pout = st->scratch;
+    for (d = 0; d < digits; d++)
+    {
+        /* all keys share this digit: the pass would not move anything */
+        if (count[d][(kin[0] >> (d * SK_RADIX_BITS)) & (SK_RADIX_SIZE - 1)] == (size_t)n)
+        {
+            continue;
+        }
+        for (pos = 0, t = 0; t < SK_RADIX_SIZE; t++)
+        {
+            c = count[d][t];
+            count[d][t] = pos;
+            pos += c;
+        }
+        for (i = 0; i < n; i++)
+        {
+            pos = count[d][(kin[i] >> (d * SK_RADIX_BITS)) & (SK_RADIX_SIZE - 1)]++;
+            kout[pos] = kin[i];
+            pout[pos] = pin[i];
+        }
+        kt = kin;
+        kin = kout;
+        kout = kt;
+        pt = pin;
+        pin = pout;
+        pout = pt;
+    }
+
+    /* the result may have ended up in the scratch buffer: swap, don't copy */
+    if (pin != st->data)
+    {
+        t = st->num_alloc;
+        st->num_alloc = st->scratch_alloc;
+        st->scratch_alloc = t;
+        st->scratch = st->data;
+        st->data = pin;
+    }
+    OPENSSL_free(keys);
+    OPENSSL_free(count);
+    st->sorted = 1;
+    st->gen++;
+    sk_index_refresh(st);
+    return 1;
+}
+
+static int sk_ptr_cmp(const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t)*(const void* const*)a;
+    uintptr_t y = (uintptr_t)*(const void* const*)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+* Passes each distinct pointer of the run |st->data[s..e)|, other than
+* |kept| and NULL, to |func| exactly once: the same object may have been
+* pushed more than once.  Long runs are deduplicated by sorting a copy of
+* their pointers in the scratch buffer, short ones (or all of them without
+* memory for it) by looking back over the run.
+*/
+static void sk_uniq_free_run(OPENSSL_STACK* st, int s, int e,
+                             const void* kept, OPENSSL_sk_freefunc func)
+{
+    const void** tmp;
+    const void* p;
+    int i, k, n = e - s;
+
+    if (n > 16 && st->scratch_alloc < n)
+    {
+        tmp = (const void**)OPENSSL_realloc((void*)st->scratch,
+                                            sizeof(*tmp) * n);
+        if (tmp != NULL)
+        {
+            st->scratch = tmp;
+            st->scratch_alloc = n;
+        }
+    }
+    if (n > 16 && st->scratch_alloc >= n)
+    {
+        memcpy((void*)st->scratch, (const void*)&st->data[s],
+               sizeof(*tmp) * n);
+        qsort((void*)st->scratch, n, sizeof(*tmp), sk_ptr_cmp);
+        for (i = 0; i < n; i++)
+        {
+            p = st->scratch[i];
+            if (p != NULL && p != kept && (i == 0 || p != st->scratch[i - 1]))
+            {
+                func((void*)p);
+            }
+        }
+        return;
+    }
+
+    for (i = s; i < e; i++)
+    {
+        p = st->data[i];
+        if (p == NULL || p == kept)
+        {
+            continue;
+        }
+        for (k = s; k < i && st->data[k] != p; k++)
+            continue;
+        if (k == i)
+        {
+            func((void*)p);
+        }
+    }
+}
+
+static int internal_uniq(OPENSSL_STACK* st, OPENSSL_sk_freefunc func,
+                         int keep_last)
+{
+    const void* kept;
+    int s, e, j;
+
+    if (st == NULL || st->comp == NULL || sk_is_view(st))
+    {
+        return -1;
+    }
+    internal_sort(st);
+    sk_flatten(st);
+    if (st->num < 2)
+    {
+        return st->num;
+    }
+
+    /*
+    * |data[s..e)| is the current run of equal elements; it is still intact
+    * when handled, the kept elements are written at |j| <= |s|.
+    */
+    for (s = 0, j = 0; s < st->num; s = e)
+    {
+        for (e = s + 1;
+             e < st->num && st->comp(&st->data[s], &st->data[e]) == 0; e++)
+            continue;
+        kept = st->data[keep_last ? e - 1 : s];
+        if (func != NULL && e - s > 1)
+        {
+            sk_uniq_free_run(st, s, e, kept, func);
+        }
+        st->data[j++] = kept;
+    }
+    if (j < st->num)
+    {
+        st->num = j;
+        st->gen++;
+    }
+    return st->num;
+}
+
+/*
+* Sorts |st| if needed and drops all but the first element of each run of
+* elements that compare equal, in one pass.  The dropped elements are passed
+* to |func| unless it is NULL.  Returns the new number of elements, or -1 if
+* |st| is NULL or has no comparison function.
+*/
+int OPENSSL_sk_uniq(OPENSSL_STACK* st, OPENSSL_sk_freefunc func)
+{
+    return internal_uniq(st, func, 0);
+}
+
+/*
+* As OPENSSL_sk_uniq(), but keeps the last element of each run.  Which
+* element that is only has a meaning for a stable stack (see
+* OPENSSL_sk_set_stable()), where it is the last one inserted; otherwise the
+* sort may have put the run in any order.
+*/
+int OPENSSL_sk_uniq_last(OPENSSL_STACK* st, OPENSSL_sk_freefunc func)
+{
+    return internal_uniq(st, func, 1);
+}
+
+int OPENSSL_sk_is_sorted(const OPENSSL_STACK* st)
+{
+    return st == NULL ? 1 : st->sorted;
+}
+
+/*
+* Calls |fn(element, arg)| on every element in order, without the per-element
+* checks of sk_value().  |fn| returns non-zero to continue; the walk stops at
+* the first element for which it returns 0 and that index is returned.  -1
+* means every element was visited.  |fn| must not modify the stack.
+*/
+int OPENSSL_sk_foreach(const OPENSSL_STACK* st, OPENSSL_sk_foreachfunc fn,
+                       void* arg)
+{
+    const void** data;
+    int i, num;
+
+    SK_VIEW_CHECK(st);
+    if (st == NULL)
+    {
+        return -1;
+    }
+    num = st->num;
+    if (st->chunks != NULL)
+    {
+        for (i = 0; i < num; i++)
+            if (!fn((void*)*sk_chunk_slot(st, i), arg))
+            {
+                return i;
+            }
+        return -1;
+    }
+    data = st->data;
+    for (i = 0; i < num; i++)
+        if (!fn((void*)data[i], arg))
+        {
+            return i;
+        }
+    return -1;
+}
+
+void OPENSSL_sk_iter_init(OPENSSL_SK_ITER* it, const OPENSSL_STACK* st,
+                          int distance, int offset)
+{
+    SK_VIEW_CHECK(st);
+    /* a chunked stack is read through OPENSSL_sk_value() */
+    it->st = st;
+    it->data = st == NULL || st->chunks != NULL ? NULL : st->data;
+    it->num = st == NULL ? 0 : st->num;
+    it->i = 0;
+    it->distance = sk_prefetch_distance(it->num, distance);
+    it->offset = offset;
+}
+
+/*
+* OPENSSL_sk_foreach() that prefetches the element |distance| slots ahead
+* (at byte |offset| into it) before calling |fn| on the current one, so that
+* the cache misses on scattered elements overlap instead of serialising.
+*/
+int OPENSSL_sk_foreach_prefetch(const OPENSSL_STACK* st,
+                                OPENSSL_sk_foreachfunc fn, void* arg,
+                                int distance, int offset)
+{
+    int i, num, d;
+
+    if (st == NULL)
+    {
+        return -1;
+    }
+    num = st->num;
+    d = sk_prefetch_distance(num, distance);
+    if (d == 0)
+    {
+        return OPENSSL_sk_foreach(st, fn, arg);
+    }
+    for (i = 0; i < d && i < num; i++)
+    {
+        sk_prefetch_elem(*sk_slot(st, i), offset);
+    }
+    for (i = 0; i + d < num; i++)
+    {
+        sk_prefetch_elem(*sk_slot(st, i + d), offset);
+        if (!fn((void*)*sk_slot(st, i), arg))
+        {
+            return i;
+        }
+    }
+    for (; i < num; i++)
+        if (!fn((void*)*sk_slot(st, i), arg))
+        {
+            return i;
+        }
+    return -1;
+}
+
+#ifdef OPENSSL_THREADS
+struct sk_foreach_job
+{
+    const OPENSSL_STACK* st;
+    int start;
+    int end;
+    OPENSSL_sk_foreachfunc fn;
+    void* arg;
+    int* stop;
+};
+
+static void* sk_foreach_worker(void* job_)
+{
+    struct sk_foreach_job* job = (struct sk_foreach_job*)job_;
+    int i, stop;
+
+    for (i = job->start; i < job->end; i++)
+    {
+        /* a lower index already failed, nothing left to find here */
+        if (__atomic_load_n(job->stop, __ATOMIC_RELAXED) < i)
+        {
+            break;
+        }
+        if (!job->fn((void*)*sk_slot(job->st, i), job->arg))
+        {
+            stop = __atomic_load_n(job->stop, __ATOMIC_RELAXED);
+            while (i < stop
+                   && !__atomic_compare_exchange_n(job->stop, &stop, i, 0,
+                           __ATOMIC_RELAXED,
+                           __ATOMIC_RELAXED))
+                continue;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+* Worker threads of OPENSSL_sk_foreach_parallel(), started on first use and
+* kept for the life of the process.  One call at a time hands them its
+* ranges, which the caller claims too, so that a call never waits for a
+* worker that could not be started.
+*/
+struct sk_workers_st
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;            /* a call has ranges to claim */
+    pthread_cond_t done;            /* the last range of a call finished */
+    struct sk_foreach_job* jobs;    /* ranges of the current call */
+    int njobs;
+    int next;                       /* first range not claimed yet */
+    int pending;                    /* ranges not finished yet */
+    int nworkers;
+};
+
+static struct sk_workers_st sk_workers =
+{
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0, 0
+};
+static pthread_mutex_t sk_workers_call = PTHREAD_MUTEX_INITIALIZER;
+
+/* Called with |sk_workers.lock| held, which it releases while visiting */
+static void sk_workers_claim(void)
+{
+    struct sk_foreach_job* job = &sk_workers.jobs[sk_workers.next++];
+
+    pthread_mutex_unlock(&sk_workers.lock);
+    sk_foreach_worker(job);
+    pthread_mutex_lock(&sk_workers.lock);
+    if (--sk_workers.pending == 0)
+    {
+        pthread_cond_signal(&sk_workers.done);
+    }
+}
+
+static void* sk_workers_main(void* unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&sk_workers.lock);
+    for (;;)
+    {
+        while (sk_workers.next >= sk_workers.njobs)
+        {
+            pthread_cond_wait(&sk_workers.work, &sk_workers.lock);
+        }
+        sk_workers_claim();
+    }
     return NULL;
 }
 
-OPENSSL_STACK* OPENSSL_sk_deep_copy(const OPENSSL_STACK* sk,
-                                    OPENSSL_sk_copyfunc copy_func,
-                                    OPENSSL_sk_freefunc free_func)
+/*
+* Visits |jobs| on the worker threads, starting more of them if needed.
+* Returns 0 without visiting anything if another call is using them, e.g.
+* a nested one from |fn|.
+*/
+static int sk_workers_run(struct sk_foreach_job* jobs, int njobs)
+{
+    pthread_t tid;
+
+    if (pthread_mutex_trylock(&sk_workers_call) != 0)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&sk_workers.lock);
+    while (sk_workers.nworkers < njobs - 1
+           && sk_workers.nworkers < OPENSSL_SK_MAX_WORKERS
+           && pthread_create(&tid, NULL, sk_workers_main, NULL) == 0)
+    {
+        pthread_detach(tid);
+        sk_workers.nworkers++;
+    }
+    sk_workers.jobs = jobs;
+    sk_workers.njobs = njobs;
+    sk_workers.next = 0;
+    sk_workers.pending = njobs;
+    pthread_cond_broadcast(&sk_workers.work);
+    while (sk_workers.next < njobs)
+    {
+        sk_workers_claim();
+    }
+    while (sk_workers.pending > 0)
+    {
+        pthread_cond_wait(&sk_workers.done, &sk_workers.lock);
+    }
+    sk_workers.jobs = NULL;
+    sk_workers.njobs = 0;
+    sk_workers.next = 0;
+    pthread_mutex_unlock(&sk_workers.lock);
+    pthread_mutex_unlock(&sk_workers_call);
+    return 1;
+}
+#endif
+
+/*
+* Same contract as OPENSSL_sk_foreach(), with the elements split in
+* |nthreads| contiguous ranges (one per online CPU if |nthreads| <= 0) that
+* are visited concurrently, so |fn| must be thread-safe.  Elements are not
+* visited in order, but when |fn| fails the result is still the lowest
+* failing index.  The ranges go to worker threads kept between calls, up
+* to OPENSSL_SK_MAX_WORKERS of them, or to threads started for the call if
+* another call is using the workers.  Without thread support this is
+* OPENSSL_sk_foreach().
+*/
+int OPENSSL_sk_foreach_parallel(const OPENSSL_STACK* st,
+                                OPENSSL_sk_foreachfunc fn, void* arg,
+                                int nthreads)
+{
+#ifdef OPENSSL_THREADS
+    struct sk_foreach_job* jobs;
+    pthread_t* tids;
+    char* started;
+    int i, chunk, stop;
+
+    if (st == NULL)
+    {
+        return -1;
+    }
+    if (nthreads <= 0)
+    {
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads > st->num)
+    {
+        nthreads = st->num;
+    }
+    if (nthreads <= 1)
+    {
+        return OPENSSL_sk_foreach(st, fn, arg);
+    }
+
+    jobs = (struct sk_foreach_job*)OPENSSL_malloc(sizeof(*jobs) * nthreads);
+    if (jobs == NULL)
+    {
+        return OPENSSL_sk_foreach(st, fn, arg);
+    }
+
+    stop = INT_MAX;
+    chunk = st->num / nthreads;
+    for (i = 0; i < nthreads; i++)
+    {
+        jobs[i].st = st;
+        jobs[i].start = i * chunk;
+        jobs[i].end = i == nthreads - 1 ? st->num : (i + 1) * chunk;
+        jobs[i].fn = fn;
+        jobs[i].arg = arg;
+        jobs[i].stop = &stop;
+    }
+    if (sk_workers_run(jobs, nthreads))
+    {
+        OPENSSL_free(jobs);
+        return stop == INT_MAX ? -1 : stop;
+    }
+
+    tids = (pthread_t*)OPENSSL_malloc(sizeof(*tids) * nthreads);
+    started = (char*)OPENSSL_zalloc(nthreads);
+    if (tids == NULL || started == NULL)
+    {
+        OPENSSL_free(jobs);
+        OPENSSL_free(tids);
+        OPENSSL_free(started);
+        return OPENSSL_sk_foreach(st, fn, arg);
+    }
+    /* the calling thread takes range 0; a range whose thread can't be created runs inline */
+    for (i = 1; i < nthreads; i++)
+    {
+        started[i] = pthread_create(&tids[i], NULL, sk_foreach_worker, &jobs[i]) == 0;
+    }
+    sk_foreach_worker(&jobs[0]);
+    for (i = 1; i < nthreads; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(tids[i], NULL);
+        }
+        else
+        {
+            sk_foreach_worker(&jobs[i]);
+        }
+    }
+
+    OPENSSL_free(jobs);
+    OPENSSL_free(tids);
+    OPENSSL_free(started);
+    return stop == INT_MAX ? -1 : stop;
+#else
+    (void)nthreads;
+    return OPENSSL_sk_foreach(st, fn, arg);
+#endif
+}
+
+#ifndef OPENSSL_SK_CACHE_LINE
+# define OPENSSL_SK_CACHE_LINE           64
+#endif
+
+/* A shard padded to whole cache lines, so pushes never share one */
+typedef union sk_collector_shard_un
+{
+    OPENSSL_STACK st;
+    char pad[(sizeof(OPENSSL_STACK) + OPENSSL_SK_CACHE_LINE - 1)
+             / OPENSSL_SK_CACHE_LINE * OPENSSL_SK_CACHE_LINE];
+} SK_COLLECTOR_SHARD;
+
+struct sk_collector_st
+{
+    SK_COLLECTOR_SHARD* shards;     /* cache line aligned, in |mem| */
+    void* mem;
+    int nshards;
+    int claimed;
+    OPENSSL_sk_compfunc comp;
+};
+
+/*
+* A collector of |nshards| stacks with comparison function |c|, one per
+* online CPU if |nshards| <= 0.
+*/
+OPENSSL_SK_COLLECTOR* OPENSSL_sk_collector_new(OPENSSL_sk_compfunc c,
+        int nshards)
+{
+    OPENSSL_SK_COLLECTOR* col;
+    size_t align = OPENSSL_SK_CACHE_LINE;
+    int i;
+
+    if (nshards <= 0)
+    {
+#ifdef OPENSSL_THREADS
+        nshards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (nshards <= 0)
+        {
+            nshards = 1;
+        }
+    }
+    if ((size_t)nshards > (SIZE_MAX - align) / sizeof(SK_COLLECTOR_SHARD))
+    {
+        return NULL;
+    }
+    if ((col = (OPENSSL_SK_COLLECTOR*)OPENSSL_zalloc(sizeof(*col))) == NULL)
+    {
+        return NULL;
+    }
+    col->mem = OPENSSL_zalloc(sizeof(SK_COLLECTOR_SHARD) * nshards + align);
+    if (col->mem == NULL)
+    {
+        OPENSSL_free(col);
+        return NULL;
+    }
+    col->shards = (SK_COLLECTOR_SHARD*)((char*)col->mem
+                  + (align - (size_t)col->mem % align) % align);
+    col->nshards = nshards;
+    col->comp = c;
+    for (i = 0; i < nshards; i++)
+    {
+        col->shards[i].st.comp = c;
+        col->shards[i].st.embedded = 1;
+    }
+    return col;
+}
+
+/* Frees the shards but not the elements left in them */
+void OPENSSL_sk_collector_free(OPENSSL_SK_COLLECTOR* col)
+{
+    OPENSSL_STACK* st;
+    int i;
+
+    if (col == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < col->nshards; i++)
+    {
+        st = &col->shards[i].st;
+        if (st->chunks != NULL)
+        {
+            sk_chunks_free(st->chunks);
+        }
+        sk_index_free(st);
+        OPENSSL_free((void*)st->scratch);
+        sk_data_release(st->data, st->num_alloc);
+    }
+    OPENSSL_free(col->mem);
+    OPENSSL_free(col);
+}
+
+int OPENSSL_sk_collector_num_shards(const OPENSSL_SK_COLLECTOR* col)
+{
+    return col == NULL ? -1 : col->nshards;
+}
+
+OPENSSL_STACK* OPENSSL_sk_collector_shard(OPENSSL_SK_COLLECTOR* col, int i)
+{
+    if (col == NULL || i < 0 || i >= col->nshards)
+    {
+        return NULL;
+    }
+    return &col->shards[i].st;
+}
+
+/*
+* Hands the next unclaimed shard to the calling thread, which keeps using it
+* for as long as the collector lives.  Returns NULL once all are claimed.
+*/
+OPENSSL_STACK* OPENSSL_sk_collector_claim(OPENSSL_SK_COLLECTOR* col)
+{
+    int i;
+
+    if (col == NULL)
+    {
+        return NULL;
+    }
+#ifdef OPENSSL_THREADS
+    i = __atomic_fetch_add(&col->claimed, 1, __ATOMIC_RELAXED);
+#else
+    i = col->claimed++;
+#endif
+    return i < col->nshards ? &col->shards[i].st : NULL;
+}
+
+/* Total number of elements in the shards, or -1 if it overflows */
+static int sk_collector_total(const OPENSSL_SK_COLLECTOR* col)
+{
+    int i, total = 0;
+
+    for (i = 0; i < col->nshards; i++)
+    {
+        if (col->shards[i].st.num > max_nodes - total)
+        {
+            return -1;
+        }
+        total += col->shards[i].st.num;
+    }
+    return total;
+}
+
+/* Leaves a shard empty, keeping its storage for the next round */
+static void sk_collector_empty(OPENSSL_STACK* st)
+{
+    st->num = 0;
+    st->sorted = 0;
+    st->gen++;
+}
+
+/*
+* Moves the elements of all the shards, in shard order, to a new stack
+* sized once for all of them.  Must not run concurrently with pushes to the
+* shards, which are left empty.  Returns NULL on error.
+*/
+OPENSSL_STACK* OPENSSL_sk_collector_gather(OPENSSL_SK_COLLECTOR* col)
+{
+    OPENSSL_STACK* ret;
+    OPENSSL_STACK* st;
+    int i, total, nonempty = 0;
+
+    if (col == NULL || (total = sk_collector_total(col)) < 0)
+    {
+        return NULL;
+    }
+    if ((ret = OPENSSL_sk_new_reserve(col->comp, total)) == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < col->nshards; i++)
+    {
+        st = &col->shards[i].st;
+        if (st->num == 0)
+        {
+            continue;
+        }
+        sk_flatten(st);
+        memcpy((void*)&ret->data[ret->num], (const void*)st->data,
+               sizeof(*st->data) * st->num);
+        ret->num += st->num;
+        /* a single sorted shard is all of the result */
+        ret->sorted = nonempty++ == 0 && st->sorted && st->comp == col->comp;
+        sk_collector_empty(st);
+    }
+    return ret;
+}
+
+/* Sifts cursor |i| down the min-heap |h| of |n| shard cursors */
+static void sk_collector_heap_down(OPENSSL_sk_compfunc comp,
+                                   const void*** cur, int* h, int n, int i)
+{
+    int c, t;
+
+    for (;;)
+    {
+        c = 2 * i + 1;
+        if (c >= n)
+        {
+            return;
+        }
+        /* ties go to the lower shard, which keeps the merge stable */
+        if (c + 1 < n)
+        {
+            t = comp(cur[h[c + 1]], cur[h[c]]);
+            if (t < 0 || (t == 0 && h[c + 1] < h[c]))
+            {
+                c++;
+            }
+        }
+        t = comp(cur[h[c]], cur[h[i]]);
+        if (t > 0 || (t == 0 && h[c] > h[i]))
+        {
+            return;
+        }
+        t = h[i];
+        h[i] = h[c];
+        h[c] = t;
+        i = c;
+    }
+}
+
+/*
+* Like OPENSSL_sk_collector_gather(), but the result is sorted: the shards
+* are sorted where needed and merged k ways, equal elements keeping their
+* shard order.  Needs a comparison function shared by all the shards.
+*/
+OPENSSL_STACK* OPENSSL_sk_collector_merge(OPENSSL_SK_COLLECTOR* col)
+{
+    OPENSSL_STACK* ret;
+    OPENSSL_STACK* st;
+    const void*** cur;
+    const void*** end;
+    int* h;
+    int i, n, total;
+
+    if (col == NULL || col->comp == NULL
+        || (total = sk_collector_total(col)) < 0)
+    {
+        return NULL;
+    }
+    for (i = 0; i < col->nshards; i++)
+    {
+        if (col->shards[i].st.comp != col->comp)
+        {
+            return NULL;
+        }
+    }
+    if ((ret = OPENSSL_sk_new_reserve(col->comp, total)) == NULL)
+    {
+        return NULL;
+    }
+    cur = (const void***)OPENSSL_malloc(sizeof(*cur) * col->nshards);
+    end = (const void***)OPENSSL_malloc(sizeof(*end) * col->nshards);
+    h = (int*)OPENSSL_malloc(sizeof(*h) * col->nshards);
+    if (cur == NULL || end == NULL || h == NULL)
+    {
+        OPENSSL_free(cur);
+        OPENSSL_free(end);
+        OPENSSL_free(h);
+        OPENSSL_sk_free(ret);
+        return NULL;
+    }
+
+    n = 0;
+    for (i = 0; i < col->nshards; i++)
+    {
+        st = &col->shards[i].st;
+        if (st->num == 0)
+        {
+            continue;
+        }
+        internal_sort(st);
+        sk_flatten(st);
+        cur[i] = st->data;
+        end[i] = st->data + st->num;
+        h[n++] = i;
+    }
+    for (i = n / 2 - 1; i >= 0; i--)
+    {
+        sk_collector_heap_down(col->comp, cur, h, n, i);
+    }
+    while (n > 1)
+    {
+        i = h[0];
+        ret->data[ret->num++] = *cur[i]++;
+        if (cur[i] == end[i])
+        {
+            h[0] = h[--n];
+        }
+        sk_collector_heap_down(col->comp, cur, h, n, 0);
+    }
+    if (n == 1)
+    {
+        i = h[0];
+        memcpy((void*)&ret->data[ret->num], (const void*)cur[i],
+               sizeof(**cur) * (end[i] - cur[i]));
+        ret->num += (int)(end[i] - cur[i]);
+    }
+    ret->sorted = 1;
+
+    for (i = 0; i < col->nshards; i++)
+    {
+        sk_collector_empty(&col->shards[i].st);
+    }
+    OPENSSL_free(cur);
+    OPENSSL_free(end);
+    OPENSSL_free(h);
+    return ret;
+}
+
+#ifdef OPENSSL_THREADS
+# define SK_RCU_LOAD(p)         __atomic_load_n(p, __ATOMIC_SEQ_CST)
+# define SK_RCU_STORE(p, v)     __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+# define SK_RCU_LOCK(rcu)       pthread_mutex_lock(&(rcu)->lock)
+# define SK_RCU_UNLOCK(rcu)     pthread_mutex_unlock(&(rcu)->lock)
+#else
+# define SK_RCU_LOAD(p)         (*(p))
+# define SK_RCU_STORE(p, v)     (*(p) = (v))
+# define SK_RCU_LOCK(rcu)       ((void)0)
+# define SK_RCU_UNLOCK(rcu)     ((void)0)
+#endif
+
+/* A snapshot replaced at epoch |epoch|, freed once all readers are past it */
+typedef struct sk_rcu_retired_st
+{
+    OPENSSL_STACK* st;
+    unsigned long epoch;
+    struct sk_rcu_retired_st* next;
+} SK_RCU_RETIRED;
+
+struct sk_rcu_st
+{
+    OPENSSL_STACK* current;
+    unsigned long epoch;            /* bumped by each publication */
+#ifdef OPENSSL_THREADS
+    pthread_mutex_t lock;           /* writers, readers list, retired list */
+#endif
+    OPENSSL_SK_RCU_READER* readers;
+    SK_RCU_RETIRED* retired;
+    OPENSSL_STACK* draft;           /* copy handed out by write_begin */
+    unsigned int draft_gen;
+    int writing;                    /* a write is open, for debug checks */
+#ifdef OPENSSL_THREADS
+    pthread_t writer;
+#endif
+};
+
+struct sk_rcu_reader_st
+{
+    /* epoch seen on entering the read section, 0 outside of it */
+    unsigned long epoch;
+    int nest;
+    OPENSSL_SK_RCU* rcu;
+    OPENSSL_SK_RCU_READER* next;
+    char pad[OPENSSL_SK_CACHE_LINE];    /* keeps readers off each other's line */
+};
+
+/*
+* Readies |st| to be published: sorted and flat, and with a fresh search
+* index even if it was sorted already (after deletes, say), so that readers
+* never have anything to write.
+*/
+static void sk_rcu_prepare(OPENSSL_STACK* st)
+{
+    if (st->comp != NULL)
+    {
+        internal_sort(st);
+    }
+    sk_flatten(st);
+    if (st->comp != NULL)
+    {
+        sk_index_refresh(st);
+    }
+}
+
+/*
+* Publishes |st|, which must not be a view, as the first snapshot (an empty
+* stack if NULL).  The RCU stack owns it from then on.
+*/
+OPENSSL_SK_RCU* OPENSSL_sk_rcu_new(OPENSSL_STACK* st)
+{
+    OPENSSL_SK_RCU* rcu;
+
+    if (st != NULL && sk_is_view(st))
+    {
+        return NULL;
+    }
+    if ((rcu = (OPENSSL_SK_RCU*)OPENSSL_zalloc(sizeof(*rcu))) == NULL)
+    {
+        return NULL;
+    }
+    if (st == NULL && (st = OPENSSL_sk_new_null()) == NULL)
+    {
+        OPENSSL_free(rcu);
+        return NULL;
+    }
+#ifdef OPENSSL_THREADS
+    if (pthread_mutex_init(&rcu->lock, NULL) != 0)
+    {
+        OPENSSL_free(rcu);
+        return NULL;
+    }
+#endif
+    sk_rcu_prepare(st);
+    rcu->current = st;
+    rcu->epoch = 1;
+    return rcu;
+}
+
+/*
+* Frees the RCU stack, its snapshots and, with |func| on the current
+* snapshot, the elements.  There must be no readers or writers left.
+*/
+void OPENSSL_sk_rcu_free(OPENSSL_SK_RCU* rcu, OPENSSL_sk_freefunc func)
+{
+    SK_RCU_RETIRED* r;
+    OPENSSL_SK_RCU_READER* rd;
+
+    if (rcu == NULL)
+    {
+        return;
+    }
+    while ((r = rcu->retired) != NULL)
+    {
+        rcu->retired = r->next;
+        OPENSSL_sk_free(r->st);
+        OPENSSL_free(r);
+    }
+    while ((rd = rcu->readers) != NULL)
+    {
+        rcu->readers = rd->next;
+        OPENSSL_free(rd);
+    }
+    if (func != NULL)
+    {
+        OPENSSL_sk_pop_free(rcu->current, func);
+    }
+    else
+    {
+        OPENSSL_sk_free(rcu->current);
+    }
+#ifdef OPENSSL_THREADS
+    pthread_mutex_destroy(&rcu->lock);
+#endif
+    OPENSSL_free(rcu);
+}
+
+OPENSSL_SK_RCU_READER* OPENSSL_sk_rcu_reader_new(OPENSSL_SK_RCU* rcu)
+{
+    OPENSSL_SK_RCU_READER* rd;
+
+    if (rcu == NULL)
+    {
+        return NULL;
+    }
+    rd = (OPENSSL_SK_RCU_READER*)OPENSSL_zalloc(sizeof(*rd));
+    if (rd == NULL)
+    {
+        return NULL;
+    }
+    rd->rcu = rcu;
+    SK_RCU_LOCK(rcu);
+    rd->next = rcu->readers;
+    rcu->readers = rd;
+    SK_RCU_UNLOCK(rcu);
+    return rd;
+}
+
+/* |rd| must be outside of any read section */
+void OPENSSL_sk_rcu_reader_free(OPENSSL_SK_RCU_READER* rd)
+{
+    OPENSSL_SK_RCU_READER** p;
+
+    if (rd == NULL)
+    {
+        return;
+    }
+    SK_RCU_LOCK(rd->rcu);
+    for (p = &rd->rcu->readers; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == rd)
+        {
+            *p = rd->next;
+            break;
+        }
+    }
+    SK_RCU_UNLOCK(rd->rcu);
+    OPENSSL_free(rd);
+}
+
+/*
+* Enters a read section and returns the current snapshot; sections nest.
+* Wait-free: the epoch is announced before the snapshot pointer is loaded,
+* so a writer either sees the announcement or has already published.
+*/
+const OPENSSL_STACK* OPENSSL_sk_rcu_read_lock(OPENSSL_SK_RCU_READER* rd)
+{
+    if (rd->nest++ == 0)
+    {
+        SK_RCU_STORE(&rd->epoch, SK_RCU_LOAD(&rd->rcu->epoch));
+    }
+    return SK_RCU_LOAD(&rd->rcu->current);
+}
+
+void OPENSSL_sk_rcu_read_unlock(OPENSSL_SK_RCU_READER* rd)
+{
+    if (--rd->nest == 0)
+    {
+#ifdef OPENSSL_THREADS
+        __atomic_store_n(&rd->epoch, 0, __ATOMIC_RELEASE);
+#else
+        rd->epoch = 0;
+#endif
+    }
+}
+
+/*
+* OPENSSL_sk_find() on the snapshot |snap| from OPENSSL_sk_rcu_read_lock(),
+* which it only reads: the snapshot is sorted and indexed when published.
+*/
+int OPENSSL_sk_rcu_find(const OPENSSL_STACK* snap, const void* data)
+{
+    return sk_find_nosort(snap, data, OBJ_BSEARCH_FIRST_VALUE_ON_MATCH);
+}
+
+/* Oldest epoch announced by a reader in a read section, ULONG_MAX if none */
+static unsigned long sk_rcu_oldest(OPENSSL_SK_RCU* rcu)
+{
+    OPENSSL_SK_RCU_READER* rd;
+    unsigned long e, oldest = ULONG_MAX;
+
+    for (rd = rcu->readers; rd != NULL; rd = rd->next)
+    {
+        e = SK_RCU_LOAD(&rd->epoch);
+        if (e != 0 && e < oldest)
+        {
+            oldest = e;
+        }
+    }
+    return oldest;
+}
+
+/*
+* Frees the retired snapshots no reader can see any more, those retired
+* before the oldest epoch announced by a reader in a read section.  Called
+* with the lock held; returns how many are still pending.
+*/
+static int sk_rcu_reclaim(OPENSSL_SK_RCU* rcu)
+{
+    SK_RCU_RETIRED** p;
+    SK_RCU_RETIRED* r;
+    unsigned long oldest;
+    int pending = 0;
+
+    if (rcu->retired == NULL)
+    {
+        return 0;
+    }
+    oldest = sk_rcu_oldest(rcu);
+    p = &rcu->retired;
+    while ((r = *p) != NULL)
+    {
+        if (r->epoch < oldest)
+        {
+            *p = r->next;
+            OPENSSL_sk_free(r->st);
+            OPENSSL_free(r);
+        }
+        else
+        {
+            pending++;
+            p = &r->next;
+        }
+    }
+    return pending;
+}
+
+#ifndef NDEBUG
+/* Whether the calling thread has a write open */
+static int sk_rcu_is_writer(const OPENSSL_SK_RCU* rcu)
+{
+# ifdef OPENSSL_THREADS
+    return rcu->writing && pthread_equal(rcu->writer, pthread_self());
+# else
+    return rcu->writing;
+# endif
+}
+#endif
+
+/* Called by the writer, drops the open write and releases the lock */
+static void sk_rcu_write_end(OPENSSL_SK_RCU* rcu)
+{
+    rcu->draft = NULL;
+    rcu->writing = 0;
+    SK_RCU_UNLOCK(rcu);
+}
+
+/*
+* Starts a write: takes the writer lock and returns a private copy of the
+* current snapshot, to be modified at will and then passed to
+* OPENSSL_sk_rcu_write_commit() or OPENSSL_sk_rcu_write_abort().  The copy
+* reuses data buffers freed by earlier reclamations in this thread.  Every
+* write_begin must be followed by exactly one commit or abort in the same
+* thread, and those are only valid after a write_begin, which debug builds
+* check.
+*/
+OPENSSL_STACK* OPENSSL_sk_rcu_write_begin(OPENSSL_SK_RCU* rcu)
+{
+    OPENSSL_STACK* next;
+
+    if (rcu == NULL)
+    {
+        return NULL;
+    }
+    SK_RCU_LOCK(rcu);
+    if ((next = OPENSSL_sk_dup(rcu->current)) == NULL)
+    {
+        SK_RCU_UNLOCK(rcu);
+        return NULL;
+    }
+    rcu->draft = next;
+    rcu->draft_gen = next->gen;
+    rcu->writing = 1;
+#ifdef OPENSSL_THREADS
+    rcu->writer = pthread_self();
+#endif
+    return next;
+}
+
+/*
+* Ends the write opened by OPENSSL_sk_rcu_write_begin(): publishes |next|
+* (the copy it returned or any other stack that is not a view, in which
+* case the copy is freed), retires the previous snapshot and releases the
+* writer lock.  A copy left unchanged is simply freed.  |next| is sorted
+* first if it has a comparison function, so that finds on the snapshot
+* never write to it.  Returns 0, with the write still open, for a view.
+*/
+int OPENSSL_sk_rcu_write_commit(OPENSSL_SK_RCU* rcu, OPENSSL_STACK* next)
+{
+    SK_RCU_RETIRED* r;
+    OPENSSL_STACK* old;
+    unsigned long epoch;
+
+    if (rcu == NULL || next == NULL || sk_is_view(next))
+    {
+        return 0;
+    }
+    assert(sk_rcu_is_writer(rcu));
+    if (next == rcu->draft && next->gen == rcu->draft_gen)
+    {
+        OPENSSL_sk_rcu_write_abort(rcu, next);
+        return 1;
+    }
+    sk_rcu_prepare(next);
+    if (rcu->draft != next)
+    {
+        /* another stack is published, the copy is left over */
+        OPENSSL_sk_free(rcu->draft);
+    }
+
+    old = rcu->current;
+    SK_RCU_STORE(&rcu->current, next);
+    epoch = rcu->epoch;
+    SK_RCU_STORE(&rcu->epoch, epoch + 1);
+
+    if ((r = (SK_RCU_RETIRED*)OPENSSL_malloc(sizeof(*r))) != NULL)
+    {
+        r->st = old;
+        r->epoch = epoch;
+        r->next = rcu->retired;
+        rcu->retired = r;
+        sk_rcu_reclaim(rcu);
+    }
+    else
+    {
+        /* no memory to defer it: wait out the readers that may see |old| */
+        while (sk_rcu_oldest(rcu) <= epoch)
+        {
+#ifdef OPENSSL_THREADS
+            sched_yield();
+#endif
+        }
+        OPENSSL_sk_free(old);
+    }
+    sk_rcu_write_end(rcu);
+    return 1;
+}
+
+/*
+* Ends the write opened by OPENSSL_sk_rcu_write_begin() without publishing:
+* drops |next| and the copy, and releases the writer lock.
+*/
+void OPENSSL_sk_rcu_write_abort(OPENSSL_SK_RCU* rcu, OPENSSL_STACK* next)
+{
+    if (rcu == NULL)
+    {
+        return;
+    }
+    assert(sk_rcu_is_writer(rcu));
+    if (next != rcu->current)
+    {
+        OPENSSL_sk_free(next);
+    }
+    if (rcu->draft != next)
+    {
+        OPENSSL_sk_free(rcu->draft);
+    }
+    sk_rcu_write_end(rcu);
+}
+
+/*
+* Frees what can be of the retired snapshots, for instance before freeing
+* elements removed by earlier writes.  Returns how many are still visible
+* to readers.
+*/
+int OPENSSL_sk_rcu_reclaim(OPENSSL_SK_RCU* rcu)
+{
+    int pending;
+
+    if (rcu == NULL)
+    {
+        return -1;
+    }
+    SK_RCU_LOCK(rcu);
+    pending = sk_rcu_reclaim(rcu);
+    SK_RCU_UNLOCK(rcu);
+    return pending;
+}
+
+struct value_stack_st
+{
+    int num;
+    char* data;
+    int sorted;
+    int num_alloc;
+    size_t size;
+    OPENSSL_sk_compfunc comp;
+};
+
+/* internal value stack storage allocation, same policy as sk_reserve() */
+static int vsk_reserve(OPENSSL_VSTACK* st, int n, int exact)
+{
+    char* tmpdata;
+    int num_alloc;
+
+    if (n > max_nodes - st->num)
+    {
+        return 0;
+    }
+
+    num_alloc = st->num + n;
+    if (num_alloc < min_nodes)
+    {
+        num_alloc = min_nodes;
+    }
+
+    if (!exact)
+    {
+        if (st->data != NULL && num_alloc <= st->num_alloc)
+        {
+            return 1;
+        }
+        if (st->data != NULL)
+        {
+            num_alloc = compute_growth(num_alloc, st->num_alloc);
+            if (num_alloc == 0)
+            {
+                return 0;
+            }
+        }
+    }
+    else if (st->data != NULL && num_alloc == st->num_alloc)
+    {
+        return 1;
+    }
+
+    /* unlike pointers, the element size can overflow the byte count */
+    if ((size_t)num_alloc > SIZE_MAX / st->size)
+    {
+        return 0;
+    }
+    tmpdata = (char*)OPENSSL_realloc(st->data, st->size * num_alloc);
+    if (tmpdata == NULL)
+    {
+        return 0;
+    }
+
+    st->data = tmpdata;
+    st->num_alloc = num_alloc;
+    return 1;
+}
+
+OPENSSL_VSTACK* OPENSSL_vsk_new_reserve(size_t size, OPENSSL_sk_compfunc c,
+                                        int n)
+{
+    OPENSSL_VSTACK* st;
+
+    if (size == 0)
+    {
+        return NULL;
+    }
+    if ((st = (OPENSSL_VSTACK*)OPENSSL_zalloc(sizeof(*st))) == NULL)
+    {
+        return NULL;
+    }
+
+    st->size = size;
+    st->comp = c;
+
+    if (n <= 0)
+    {
+        return st;
+    }
+
+    if (!vsk_reserve(st, n, 1))
+    {
+        OPENSSL_vsk_free(st);
+        return NULL;
+    }
+
+    return st;
+}
+
+OPENSSL_VSTACK* OPENSSL_vsk_new(size_t size, OPENSSL_sk_compfunc c)
+{
+    return OPENSSL_vsk_new_reserve(size, c, 0);
+}
+
+OPENSSL_VSTACK* OPENSSL_vsk_new_null(size_t size)
+{
+    return OPENSSL_vsk_new_reserve(size, NULL, 0);
+}
+
+int OPENSSL_vsk_reserve(OPENSSL_VSTACK* st, int n)
+{
+    if (st == NULL)
+    {
+        return 0;
+    }
+
+    if (n < 0)
+    {
+        return 1;
+    }
+    return vsk_reserve(st, n, 1);
+}
+
+OPENSSL_VSTACK* OPENSSL_vsk_dup(const OPENSSL_VSTACK* st)
+{
+    OPENSSL_VSTACK* ret;
+
+    if (st == NULL)
+    {
+        return NULL;
+    }
+    if ((ret = (OPENSSL_VSTACK*)OPENSSL_malloc(sizeof(*ret))) == NULL)
+    {
+        return NULL;
+    }
+
+    /* direct structure assignment */
+    *ret = *st;
+
+    if (st->num == 0)
+    {
+        /* postpone |ret->data| allocation */
+        ret->data = NULL;
+        ret->num_alloc = 0;
+        return ret;
+    }
+    /* one copy of the whole array, whatever the element count */
+    if ((ret->data = (char*)OPENSSL_malloc(st->size * st->num_alloc)) == NULL)
+    {
+        OPENSSL_free(ret);
+        return NULL;
+    }
+    memcpy(ret->data, st->data, st->size * st->num);
+    return ret;
+}
+
+void OPENSSL_vsk_free(OPENSSL_VSTACK* st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    OPENSSL_free(st->data);
+    OPENSSL_free(st);
+}
+
+/* |func| is called with the address of each element, e.g. to free members */
+void OPENSSL_vsk_pop_free(OPENSSL_VSTACK* st, OPENSSL_vsk_freefunc func)
+{
+    int i;
+
+    if (st == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < st->num; i++)
+    {
+        func(st->data + st->size * i);
+    }
+    OPENSSL_vsk_free(st);
+}
+
+int OPENSSL_vsk_num(const OPENSSL_VSTACK* st)
+{
+    return st == NULL ? -1 : st->num;
+}
+
+void* OPENSSL_vsk_value(const OPENSSL_VSTACK* st, int i)
+{
+    if (st == NULL || i < 0 || i >= st->num)
+    {
+        return NULL;
+    }
+    return st->data + st->size * i;
+}
+
+/* Start of the element array, for scans that index it directly */
+void* OPENSSL_vsk_data(const OPENSSL_VSTACK* st)
+{
+    return st == NULL ? NULL : st->data;
+}
+
+int OPENSSL_vsk_set(OPENSSL_VSTACK* st, int i, const void* elem)
+{
+    if (st == NULL || elem == NULL || i < 0 || i >= st->num)
+    {
+        return 0;
+    }
+    /* |elem| may be an element of |st|, even this one */
+    memmove(st->data + st->size * i, elem, st->size);
+    st->sorted = 0;
+    return 1;
+}
+
+/*
+* |elem| may be an element of |st|, e.g. OPENSSL_vsk_value(st, i): as in
+* std::vector, its offset is taken before the storage can move and
+* adjusted for the shift of the elements after |loc|.
+*/
+int OPENSSL_vsk_insert(OPENSSL_VSTACK* st, const void* elem, int loc)
+{
+    const char* src = (const char*)elem;
+    size_t off = 0;
+    int inside;
+    char* p;
+
+    if (st == NULL || elem == NULL || st->num == max_nodes)
+    {
+        return 0;
+    }
+
+    inside = st->data != NULL
+             && (uintptr_t)src >= (uintptr_t)st->data
+             && (uintptr_t)src < (uintptr_t)(st->data + st->size * st->num);
+    if (inside)
+    {
+        off = (size_t)((uintptr_t)src - (uintptr_t)st->data);
+    }
+
+    if (!vsk_reserve(st, 1, 0))
+    {
+        return 0;
+    }
+    if (inside)
+    {
+        src = st->data + off;
+    }
+
+    if ((loc >= st->num) || (loc < 0))
+    {
+        p = st->data + st->size * st->num;
+    }
+    else
+    {
+        p = st->data + st->size * loc;
+        memmove(p + st->size, p, st->size * (st->num - loc));
+        if (inside && src >= p)
+        {
+            src += st->size;
+        }
+    }
+    memcpy(p, src, st->size);
+    st->num++;
+    st->sorted = 0;
+    return st->num;
+}
+
+/* Removes element |loc|, copying it to |out| first unless that is NULL */
+int OPENSSL_vsk_delete(OPENSSL_VSTACK* st, int loc, void* out)
+{
+    char* p;
+
+    if (st == NULL || loc < 0 || loc >= st->num)
+    {
+        return 0;
+    }
+
+    p = st->data + st->size * loc;
+    if (out != NULL)
+    {
+        memcpy(out, p, st->size);
+    }
+    if (loc != st->num - 1)
+    {
+        memmove(p, p + st->size, st->size * (st->num - loc - 1));
+    }
+    st->num--;
+    return 1;
+}
+
+int OPENSSL_vsk_push(OPENSSL_VSTACK* st, const void* elem)
+{
+    if (st == NULL)
+    {
+        return -1;
+    }
+    return OPENSSL_vsk_insert(st, elem, st->num);
+}
+
+int OPENSSL_vsk_unshift(OPENSSL_VSTACK* st, const void* elem)
+{
+    return OPENSSL_vsk_insert(st, elem, 0);
+}
+
+int OPENSSL_vsk_shift(OPENSSL_VSTACK* st, void* out)
+{
+    return OPENSSL_vsk_delete(st, 0, out);
+}
+
+int OPENSSL_vsk_pop(OPENSSL_VSTACK* st, void* out)
+{
+    if (st == NULL)
+    {
+        return 0;
+    }
+    return OPENSSL_vsk_delete(st, st->num - 1, out);
+}
+
+/* No memset needed: the slots past |num| are never read */
+void OPENSSL_vsk_zero(OPENSSL_VSTACK* st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    st->num = 0;
+}
+
+OPENSSL_sk_compfunc OPENSSL_vsk_set_cmp_func(OPENSSL_VSTACK* st,
+        OPENSSL_sk_compfunc c)
+{
+    OPENSSL_sk_compfunc old = st->comp;
+
+    if (st->comp != c)
+    {
+        st->sorted = 0;
+    }
+    st->comp = c;
+
+    return old;
+}
+
+void OPENSSL_vsk_sort(OPENSSL_VSTACK* st)
+{
+    if (st != NULL && !st->sorted && st->comp != NULL)
+    {
+        if (st->num > 1)
+        {
+            qsort(st->data, st->num, st->size, st->comp);
+        }
+        st->sorted = 1; /* empty or single-element stack is considered sorted */
+    }
+}
+
+int OPENSSL_vsk_is_sorted(const OPENSSL_VSTACK* st)
+{
+    return st == NULL ? 1 : st->sorted;
+}
+
+static int internal_vfind(OPENSSL_VSTACK* st, const void* key,
+                          int ret_val_options)
+{
+    const char* r;
+    int i;
+
+    if (st == NULL || st->num == 0 || key == NULL)
+    {
+        return -1;
+    }
+
+    /* without a comparison function, elements are compared bytewise */
+    if (st->comp == NULL)
+    {
+        for (i = 0; i < st->num; i++)
+            if (memcmp(st->data + st->size * i, key, st->size) == 0)
+            {
+                return i;
+            }
+        return -1;
+    }
+
+    OPENSSL_vsk_sort(st);
+    r = (const char*)OBJ_bsearch_ex_(key, st->data, st->num, (int)st->size,
+                                     st->comp, ret_val_options);
+
+    return r == NULL ? -1 : (int)((r - st->data) / st->size);
+}
+
+int OPENSSL_vsk_find(OPENSSL_VSTACK* st, const void* key)
+{
+    return internal_vfind(st, key, OBJ_BSEARCH_FIRST_VALUE_ON_MATCH);
+}
+
+int OPENSSL_vsk_find_ex(OPENSSL_VSTACK* st, const void* key)
+{
+    return internal_vfind(st, key, OBJ_BSEARCH_VALUE_ON_NOMATCH);
+}
+
+/*
+* Capacity for a structure-of-arrays stack holding |target| rows, grown from
+* |num_alloc| with the same 3/2 policy as pointer stacks; 0 if too large.
+*/
+int OPENSSL_soa_capacity(int num_alloc, int target)
+{
+    if (target > max_nodes)
+    {
+        return 0;
+    }
+    if (num_alloc < min_nodes)
+    {
+        return target < min_nodes ? min_nodes : target;
+    }
+    return compute_growth(target, num_alloc);
+}
+
+/* Resizes one column to |num_alloc| elements of |size| bytes */
+int OPENSSL_soa_column_resize(void** column, size_t size, int num_alloc)
+{
+    void* tmp;
+
+    if (num_alloc <= 0 || (size_t)num_alloc > SIZE_MAX / size)
+    {
+        return 0;
+    }
+    if ((tmp = OPENSSL_realloc(*column, size * num_alloc)) == NULL)
+    {
+        return 0;
+    }
+    *column = tmp;
+    return 1;
+}
+
+/*
+* Scrambles one word of input so that every bit of it reaches the whole
+* state, as in the MurmurHash3 block loop.  Folding the raw word in with a
+* rotate, xor and multiply is not enough: the multiply only carries bits
+* upwards, so a difference in the top bit of one word lands, rotated, on a
+* bit of the next word, and flipping both gives the same hash.
+*/
+static ossl_inline uint64_t ossl_hash64_mix(uint64_t h, uint64_t w)
+{
+    w *= 0x87c37b91114253d5ULL;
+    w = (w << 31) | (w >> 33);
+    w *= 0x4cf5ad432745937fULL;
+    h ^= w;
+    return ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+}
+
+/*
+* 64-bit hash of |len| bytes, mixing a word at a time and finishing with
+* the MurmurHash3 avalanche.  Not meant to resist hash flooding.
+*/
+static uint64_t ossl_hash64(const void* data, size_t len)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len, w;
+
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        memcpy(&w, p, 8);
+        h = ossl_hash64_mix(h, w);
+    }
+    if (len > 0)
+    {
+        w = 0;
+        memcpy(&w, p, len);
+        h = ossl_hash64_mix(h, w);
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+typedef struct str_entry_st
+{
+    const char* str;
+    size_t len;
+    uint64_t hash;
+} STR_ENTRY;
+
+typedef struct str_chunk_st
+{
+    struct str_chunk_st* next;
+    size_t used;
+    size_t size;
+    /* string bytes follow */
+} STR_CHUNK;
+
+#define STR_POOL_CHUNK_SIZE     4096
+
+struct str_pool_st
+{
+    int references;
+    STR_CHUNK* chunks;
+    STR_ENTRY* table;       /* open addressing, linear probing */
+    size_t mask;            /* table size - 1, the size is a power of 2 */
+    size_t count;
+};
+
+struct str_stack_st
+{
+    int num;
+    STR_ENTRY* data;
+    int sorted;
+    int num_alloc;
+    OPENSSL_STR_POOL* pool;
+};
+
+OPENSSL_STR_POOL* OPENSSL_str_pool_new(void)
+{
+    OPENSSL_STR_POOL* pool;
+
+    if ((pool = (OPENSSL_STR_POOL*)OPENSSL_zalloc(sizeof(*pool))) == NULL)
+    {
+        return NULL;
+    }
+    pool->mask = 63;
+    pool->table = (STR_ENTRY*)OPENSSL_zalloc(sizeof(*pool->table) * (pool->mask + 1));
+    if (pool->table == NULL)
+    {
+        OPENSSL_free(pool);
+        return NULL;
+    }
+    pool->references = 1;
+    return pool;
+}
+
+void OPENSSL_str_pool_free(OPENSSL_STR_POOL* pool)
+{
+    STR_CHUNK* c, *next;
+
+    if (pool == NULL || --pool->references > 0)
+    {
+        return;
+    }
+    for (c = pool->chunks; c != NULL; c = next)
+    {
+        next = c->next;
+        OPENSSL_free(c);
+    }
+    OPENSSL_free(pool->table);
+    OPENSSL_free(pool);
+}
+
+static const STR_ENTRY* str_pool_probe(const OPENSSL_STR_POOL* pool,
+                                       const char* str, size_t len,
+                                       uint64_t hash)
+{
+    const STR_ENTRY* e;
+    size_t i;
+
+    for (i = (size_t)hash & pool->mask;; i = (i + 1) & pool->mask)
+    {
+        e = &pool->table[i];
+        if (e->str == NULL
+            || (e->hash == hash && e->len == len
+                && memcmp(e->str, str, len) == 0))
+        {
+            return e;
+        }
+    }
+}
+
+static int str_pool_grow(OPENSSL_STR_POOL* pool)
+{
+    STR_ENTRY* old = pool->table, *table;
+    size_t i, j, oldsize = pool->mask + 1, mask = pool->mask * 2 + 1;
+
+    if ((table = (STR_ENTRY*)OPENSSL_zalloc(sizeof(*table) * (mask + 1))) == NULL)
+    {
+        return 0;
+    }
+    /* the cached hashes make rehashing a pure move */
+    for (i = 0; i < oldsize; i++)
+    {
+        if (old[i].str == NULL)
+        {
+            continue;
+        }
+        for (j = (size_t)old[i].hash & mask; table[j].str != NULL;
+             j = (j + 1) & mask)
+            continue;
+        table[j] = old[i];
+    }
+    pool->table = table;
+    pool->mask = mask;
+    OPENSSL_free(old);
+    return 1;
+}
+
+static char* str_pool_store(OPENSSL_STR_POOL* pool, const char* str,
+                            size_t len)
+{
+    STR_CHUNK* c = pool->chunks;
+    size_t size;
+    char* p;
+
+    if (c == NULL || c->size - c->used < len + 1)
+    {
+        if (len + 1 > (size_t)-1 - sizeof(*c))
+        {
+            return NULL;
+        }
+        size = len + 1 > STR_POOL_CHUNK_SIZE ? len + 1 : STR_POOL_CHUNK_SIZE;
+        if ((c = (STR_CHUNK*)OPENSSL_malloc(sizeof(*c) + size)) == NULL)
+        {
+            return NULL;
+        }
+        c->used = 0;
+        c->size = size;
+        /* keep the partially used chunk in front if this one is a one-off */
+        if (pool->chunks != NULL && size > STR_POOL_CHUNK_SIZE)
+        {
+            c->next = pool->chunks->next;
+            pool->chunks->next = c;
+        }
+        else
+        {
+            c->next = pool->chunks;
+            pool->chunks = c;
+        }
+    }
+    p = (char*)(c + 1) + c->used;
+    memcpy(p, str, len);
+    p[len] = '\0';
+    c->used += len + 1;
+    return p;
+}
+
+static const STR_ENTRY* str_pool_intern(OPENSSL_STR_POOL* pool,
+                                        const char* str, size_t len)
+{
+    uint64_t hash = ossl_hash64(str, len);
+    STR_ENTRY* e = (STR_ENTRY*)str_pool_probe(pool, str, len, hash);
+    char* copy;
+
+    if (e->str != NULL)
+    {
+        return e;
+    }
+    /* keep the load factor at or below 1/2 */
+    if ((pool->count + 1) * 2 > pool->mask + 1)
+    {
+        if (!str_pool_grow(pool))
+        {
+            return NULL;
+        }
+        e = (STR_ENTRY*)str_pool_probe(pool, str, len, hash);
+    }
+    if ((copy = str_pool_store(pool, str, len)) == NULL)
+    {
+        return NULL;
+    }
+    e->str = copy;
+    e->len = len;
+    e->hash = hash;
+    pool->count++;
+    return e;
+}
+
+/* Returns the pool's copy of |str|, adding it first if needed */
+const char* OPENSSL_str_pool_intern(OPENSSL_STR_POOL* pool, const char* str,
+                                    size_t len)
+{
+    const STR_ENTRY* e;
+
+    if (pool == NULL || str == NULL)
+    {
+        return NULL;
+    }
+    e = str_pool_intern(pool, str, len);
+    return e == NULL ? NULL : e->str;
+}
+
+/* Returns the pool's copy of |str|, or NULL if it was never interned */
+const char* OPENSSL_str_pool_lookup(const OPENSSL_STR_POOL* pool,
+                                    const char* str, size_t len)
+{
+    if (pool == NULL || str == NULL)
+    {
+        return NULL;
+    }
+    return str_pool_probe(pool, str, len, ossl_hash64(str, len))->str;
+}
+
+OPENSSL_STRSTACK* OPENSSL_strsk_new(OPENSSL_STR_POOL* pool)
+{
+    OPENSSL_STRSTACK* st;
+
+    if ((st = (OPENSSL_STRSTACK*)OPENSSL_zalloc(sizeof(*st))) == NULL)
+    {
+        return NULL;
+    }
+    if (pool == NULL)
+    {
+        if ((st->pool = OPENSSL_str_pool_new()) == NULL)
+        {
+            OPENSSL_free(st);
+            return NULL;
+        }
+    }
+    else
+    {
+        pool->references++;
+        st->pool = pool;
+    }
+    return st;
+}
+
+void OPENSSL_strsk_free(OPENSSL_STRSTACK* st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    OPENSSL_str_pool_free(st->pool);
+    OPENSSL_free(st->data);
+    OPENSSL_free(st);
+}
+
+/* The copy shares the pool, so the strings themselves are not copied */
+OPENSSL_STRSTACK* OPENSSL_strsk_dup(const OPENSSL_STRSTACK* st)
+{
+    OPENSSL_STRSTACK* ret;
+
+    if (st == NULL)
+    {
+        return NULL;
+    }
+    if ((ret = (OPENSSL_STRSTACK*)OPENSSL_malloc(sizeof(*ret))) == NULL)
+    {
+        return NULL;
+    }
+    *ret = *st;
+    ret->data = NULL;
+    ret->num_alloc = 0;
+    if (st->num > 0)
+    {
+        ret->data = (STR_ENTRY*)OPENSSL_malloc(sizeof(*ret->data) * st->num);
+        if (ret->data == NULL)
+        {
+            OPENSSL_free(ret);
+            return NULL;
+        }
+        memcpy(ret->data, st->data, sizeof(*ret->data) * st->num);
+        ret->num_alloc = st->num;
+    }
+    ret->pool->references++;
+    return ret;
+}
+
+int OPENSSL_strsk_num(const OPENSSL_STRSTACK* st)
+{
+    return st == NULL ? -1 : st->num;
+}
+
+const char* OPENSSL_strsk_value(const OPENSSL_STRSTACK* st, int i)
+{
+    if (st == NULL || i < 0 || i >= st->num)
+    {
+        return NULL;
+    }
+    return st->data[i].str;
+}
+
+size_t OPENSSL_strsk_len(const OPENSSL_STRSTACK* st, int i)
+{
+    if (st == NULL || i < 0 || i >= st->num)
+    {
+        return 0;
+    }
+    return st->data[i].len;
+}
+
+int OPENSSL_strsk_insert_len(OPENSSL_STRSTACK* st, const char* str,
+                             size_t len, int loc)
+{
+    const STR_ENTRY* e;
+    STR_ENTRY* tmpdata;
+    int num_alloc;
+
+    if (st == NULL || str == NULL || st->num == max_nodes)
+    {
+        return 0;
+    }
+    if (st->num == st->num_alloc)
+    {
+        num_alloc = st->num_alloc < min_nodes ? min_nodes
+                    : compute_growth(st->num + 1, st->num_alloc);
+        if (num_alloc == 0)
+        {
+            return 0;
+        }
+        tmpdata = (STR_ENTRY*)OPENSSL_realloc(st->data, sizeof(*tmpdata) * num_alloc);
+        if (tmpdata == NULL)
+        {
+            return 0;
+        }
+        st->data = tmpdata;
+        st->num_alloc = num_alloc;
+    }
+    if ((e = str_pool_intern(st->pool, str, len)) == NULL)
+    {
+        return 0;
+    }
+
+    if ((loc >= st->num) || (loc < 0))
+    {
+        loc = st->num;
+    }
+    else
+    {
+        memmove(&st->data[loc + 1], &st->data[loc],
+                sizeof(st->data[0]) * (st->num - loc));
+    }
+    st->data[loc] = *e;
+    st->num++;
+    st->sorted = 0;
+    return st->num;
+}
+
+int OPENSSL_strsk_insert(OPENSSL_STRSTACK* st, const char* str, int loc)
+{
+    if (str == NULL)
+    {
+        return 0;
+    }
+    return OPENSSL_strsk_insert_len(st, str, strlen(str), loc);
+}
+
+int OPENSSL_strsk_push(OPENSSL_STRSTACK* st, const char* str)
+{
+    return OPENSSL_strsk_insert(st, str, -1);
+}
+
+const char* OPENSSL_strsk_delete(OPENSSL_STRSTACK* st, int loc)
+{
+    const char* ret;
+
+    if (st == NULL || loc < 0 || loc >= st->num)
+    {
+        return NULL;
+    }
+    ret = st->data[loc].str;
+    if (loc != st->num - 1)
+        memmove(&st->data[loc], &st->data[loc + 1],
+                sizeof(st->data[0]) * (st->num - loc - 1));
+    st->num--;
+    return ret;
+}
+
+const char* OPENSSL_strsk_pop(OPENSSL_STRSTACK* st)
+{
+    if (st == NULL)
+    {
+        return NULL;
+    }
+    return OPENSSL_strsk_delete(st, st->num - 1);
+}
+
+void OPENSSL_strsk_zero(OPENSSL_STRSTACK* st)
+{
+    if (st != NULL)
+    {
+        st->num = 0;
+    }
+}
+
+/* strcmp() order, but on the known lengths and with a pointer fast path */
+static int str_entry_cmp(const void* a_, const void* b_)
+{
+    const STR_ENTRY* a = (const STR_ENTRY*)a_;
+    const STR_ENTRY* b = (const STR_ENTRY*)b_;
+    int c;
+
+    if (a->str == b->str)
+    {
+        return 0;
+    }
+    c = memcmp(a->str, b->str, a->len < b->len ? a->len : b->len);
+    if (c != 0)
+    {
+        return c;
+    }
+    return a->len < b->len ? -1 : a->len > b->len;
+}
+
+void OPENSSL_strsk_sort(OPENSSL_STRSTACK* st)
+{
+    if (st != NULL && !st->sorted)
+    {
+        if (st->num > 1)
+        {
+            qsort(st->data, st->num, sizeof(*st->data), str_entry_cmp);
+        }
+        st->sorted = 1; /* empty or single-element stack is considered sorted */
+    }
+}
+
+int OPENSSL_strsk_is_sorted(const OPENSSL_STRSTACK* st)
+{
+    return st == NULL ? 1 : st->sorted;
+}
+
+/*
+* Index of the first entry equal to |str|, or -1.  A string that was never
+* interned in the pool is rejected by a single hash probe.  Otherwise a
+* sorted stack is binary searched and an unsorted one scanned comparing
+* interned pointers; unlike OPENSSL_sk_find(), the stack is never sorted
+* as a side effect.
+*/
+int OPENSSL_strsk_find_len(const OPENSSL_STRSTACK* st, const char* str,
+                           size_t len)
+{
+    STR_ENTRY key;
+    int i, lo, hi, mid;
+
+    if (st == NULL || str == NULL || st->num == 0)
+    {
+        return -1;
+    }
+    key.len = len;
+    key.hash = ossl_hash64(str, len);
+    key.str = str_pool_probe(st->pool, str, len, key.hash)->str;
+    if (key.str == NULL)
+    {
+        return -1;
+    }
+
+    if (!st->sorted)
+    {
+        for (i = 0; i < st->num; i++)
+            if (st->data[i].str == key.str)
+            {
+                return i;
+            }
+        return -1;
+    }
+
+    lo = 0;
+    hi = st->num;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (str_entry_cmp(&st->data[mid], &key) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo < st->num && st->data[lo].str == key.str ? lo : -1;
+}
+
+int OPENSSL_strsk_find(const OPENSSL_STRSTACK* st, const char* str)
+{
+    if (str == NULL)
+    {
+        return -1;
+    }
+    return OPENSSL_strsk_find_len(st, str, strlen(str));
+}
+
+struct compressed_stack_st
+{
+    int num;
+    uint32_t* data;
+    int sorted;
+    int num_alloc;
+    OPENSSL_sk_compfunc comp;
+    const char* base;
+    size_t size;                /* of the arena, at most OPENSSL_CSK_NULL */
+};
+
+static ossl_inline const void* csk_ptr(const OPENSSL_CSTACK* st,
+                                       uint32_t off)
+{
+    return off == OPENSSL_CSK_NULL ? NULL : st->base + off;
+}
+
+/* Compresses |p| into |*off|, returns 0 if it is outside of the arena */
+static ossl_inline int csk_off(const OPENSSL_CSTACK* st, const void* p,
+                               uint32_t* off)
+{
+    const char* c = (const char*)p;
+
+    if (p == NULL)
+    {
+        *off = OPENSSL_CSK_NULL;
+        return 1;
+    }
+    /* |p| may be in another object: compare addresses, not pointers */
+    if ((uintptr_t)c < (uintptr_t)st->base
+        || (uintptr_t)c - (uintptr_t)st->base >= st->size)
+    {
+        return 0;
+    }
+    *off = (uint32_t)((uintptr_t)c - (uintptr_t)st->base);
+    return 1;
+}
+
+/* Compares |a| with a compressed element with the pointer comparison |cmp| */
+static ossl_inline int csk_cmp(const OPENSSL_CSTACK* st,
+                               OPENSSL_sk_compfunc cmp, const void* a,
+                               uint32_t b)
+{
+    const void* pb = csk_ptr(st, b);
+
+    return cmp(&a, &pb);
+}
+
+/* Binary search of sorted |st| for |data|, as OBJ_bsearch_ex_() */
+static int csk_bsearch(const OPENSSL_CSTACK* st, const void* data,
+                       OPENSSL_sk_compfunc cmp, int ret_val_options)
+{
+    int i = 0, l = 0, h = st->num, c = 0;
+
+    while (l < h)
+    {
+        i = (l + h) / 2;
+        c = csk_cmp(st, cmp, data, st->data[i]);
+        if (c < 0)
+        {
+            h = i;
+        }
+        else if (c > 0)
+        {
+            l = i + 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (c != 0)
+    {
+        return ret_val_options & OBJ_BSEARCH_VALUE_ON_NOMATCH ? i : -1;
+    }
+    if (ret_val_options & OBJ_BSEARCH_FIRST_VALUE_ON_MATCH)
+    {
+        while (i > 0 && csk_cmp(st, cmp, data, st->data[i - 1]) == 0)
+        {
+            i--;
+        }
+    }
+    return i;
+}
+
+/* internal compressed stack storage allocation, same policy as sk_reserve() */
+static int csk_reserve(OPENSSL_CSTACK* st, int n, int exact)
+{
+    uint32_t* tmpdata;
+    int num_alloc;
+
+    if (n > max_nodes - st->num)
+    {
+        return 0;
+    }
+
+    num_alloc = st->num + n;
+    if (num_alloc < min_nodes)
+    {
+        num_alloc = min_nodes;
+    }
+
+    if (!exact)
+    {
+        if (st->data != NULL && num_alloc <= st->num_alloc)
+        {
+            return 1;
+        }
+        if (st->data != NULL)
+        {
+            num_alloc = compute_growth(num_alloc, st->num_alloc);
+            if (num_alloc == 0)
+            {
+                return 0;
+            }
+        }
+    }
+    else if (st->data != NULL && num_alloc == st->num_alloc)
+    {
+        return 1;
+    }
+
+    tmpdata = (uint32_t*)OPENSSL_realloc(st->data,
+                                         sizeof(*st->data) * num_alloc);
+    if (tmpdata == NULL)
+    {
+        return 0;
+    }
+
+    st->data = tmpdata;
+    st->num_alloc = num_alloc;
+    return 1;
+}
+
+/*
+* A compressed stack for pointers into the |size| bytes at |base|.  |size|
+* must be below 4GB (OPENSSL_CSK_NULL bytes).
+*/
+OPENSSL_CSTACK* OPENSSL_csk_new_reserve(const void* base, size_t size,
+                                        OPENSSL_sk_compfunc c, int n)
+{
+    OPENSSL_CSTACK* st;
+
+    if (base == NULL || size > OPENSSL_CSK_NULL)
+    {
+        return NULL;
+    }
+    if ((st = (OPENSSL_CSTACK*)OPENSSL_zalloc(sizeof(*st))) == NULL)
+    {
+        return NULL;
+    }
+
+    st->base = (const char*)base;
+    st->size = size;
+    st->comp = c;
+
+    if (n <= 0)
+    {
+        return st;
+    }
+
+    if (!csk_reserve(st, n, 1))
+    {
+        OPENSSL_csk_free(st);
+        return NULL;
+    }
+
+    return st;
+}
+
+OPENSSL_CSTACK* OPENSSL_csk_new(const void* base, size_t size,
+                                OPENSSL_sk_compfunc c)
+{
+    return OPENSSL_csk_new_reserve(base, size, c, 0);
+}
+
+int OPENSSL_csk_reserve(OPENSSL_CSTACK* st, int n)
+{
+    if (st == NULL)
+    {
+        return 0;
+    }
+
+    if (n < 0)
+    {
+        return 1;
+    }
+    return csk_reserve(st, n, 1);
+}
+
+void OPENSSL_csk_free(OPENSSL_CSTACK* st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    OPENSSL_free(st->data);
+    OPENSSL_free(st);
+}
+
+void OPENSSL_csk_pop_free(OPENSSL_CSTACK* st, OPENSSL_sk_freefunc func)
 {
-    OPENSSL_STACK* ret;
     int i;
 
-    if ((ret = OPENSSL_malloc(sizeof(*ret))) == NULL)
+    if (st == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < st->num; i++)
+        if (st->data[i] != OPENSSL_CSK_NULL)
+        {
+            func((void*)csk_ptr(st, st->data[i]));
+        }
+    OPENSSL_csk_free(st);
+}
+
+OPENSSL_CSTACK* OPENSSL_csk_dup(const OPENSSL_CSTACK* st)
+{
+    OPENSSL_CSTACK* ret;
+
+    if (st == NULL)
+    {
+        return NULL;
+    }
+    if ((ret = (OPENSSL_CSTACK*)OPENSSL_malloc(sizeof(*ret))) == NULL)
     {
-        //        CRYPTOerr(CRYPTO_F_OPENSSL_SK_DEEP_COPY, ERR_R_MALLOC_FAILURE);
         return NULL;
     }
 
     /* direct structure assignment */
-    *ret = *sk;
+    *ret = *st;
 
-    if (sk->num == 0)
+    if (st->num == 0)
     {
-        /* postpone |ret| data allocation */
+        /* postpone |ret->data| allocation */
         ret->data = NULL;
         ret->num_alloc = 0;
         return ret;
     }
-
-    ret->num_alloc = sk->num > min_nodes ? sk->num : min_nodes;
-    ret->data = OPENSSL_zalloc(sizeof(*ret->data) * ret->num_alloc);
+    ret->data = (uint32_t*)OPENSSL_malloc(sizeof(*ret->data) * st->num_alloc);
     if (ret->data == NULL)
     {
         OPENSSL_free(ret);
         return NULL;
     }
-
-    for (i = 0; i < ret->num; ++i)
-    {
-        if (sk->data[i] == NULL)
-        {
-            continue;
-        }
-        if ((ret->data[i] = copy_func(sk->data[i])) == NULL)
-        {
-            while (--i >= 0)
-                if (ret->data[i] != NULL)
-                {
-                    free_func((void*)ret->data[i]);
-                }
-            OPENSSL_sk_free(ret);
-            return NULL;
-        }
-    }
+    memcpy(ret->data, st->data, sizeof(*st->data) * st->num);
     return ret;
 }
 
-OPENSSL_STACK* OPENSSL_sk_new_null(void)
+int OPENSSL_csk_num(const OPENSSL_CSTACK* st)
 {
-    return OPENSSL_sk_new_reserve(NULL, 0);
+    return st == NULL ? -1 : st->num;
 }
 
-OPENSSL_STACK* OPENSSL_sk_new(OPENSSL_sk_compfunc c)
+void* OPENSSL_csk_value(const OPENSSL_CSTACK* st, int i)
 {
-    return OPENSSL_sk_new_reserve(c, 0);
+    if (st == NULL || i < 0 || i >= st->num)
+    {
+        return NULL;
+    }
+    return (void*)csk_ptr(st, st->data[i]);
 }
 
-/*
-* Calculate the array growth based on the target size.
-*
-* The growth fraction is a rational number and is defined by a numerator
-* and a denominator.  According to Andrew Koenig in his paper "Why Are
-* Vectors Efficient?" from JOOP 11(5) 1998, this factor should be less
-* than the golden ratio (1.618...).
-*
-* We use 3/2 = 1.5 for simplicity of calculation and overflow checking.
-* Another option 8/5 = 1.6 allows for slightly faster growth, although safe
-* computation is more difficult.
-*
-* The limit to avoid overflow is spot on.  The modulo three correction term
-* ensures that the limit is the largest number than can be expanded by the
-* growth factor without exceeding the hard limit.
-*
-* Do not call it with |current| lower than 2, or it will infinitely loop.
-*/
-static ossl_inline int compute_growth(int target, int current)
+void* OPENSSL_csk_set(OPENSSL_CSTACK* st, int i, const void* data)
 {
-    const int limit = (max_nodes / 3) * 2 + (max_nodes % 3 ? 1 : 0);
+    uint32_t off;
 
-    while (current < target)
+    if (st == NULL || i < 0 || i >= st->num || !csk_off(st, data, &off))
     {
-        /* Check to see if we're at the hard limit */
-        if (current >= max_nodes)
-        {
-            return 0;
-        }
-
-        /* Expand the size by a factor of 3/2 if it is within range */
-        current = current < limit ? current + current / 2 : max_nodes;
+        return NULL;
     }
-    return current;
+    st->data[i] = off;
+    st->sorted = 0;
+    return (void*)data;
 }
 
-/* internal STACK storage allocation */
-static int sk_reserve(OPENSSL_STACK* st, int n, int exact)
+/* Fails, returning 0, for a pointer outside of the arena */
+int OPENSSL_csk_insert(OPENSSL_CSTACK* st, const void* data, int loc)
 {
-    const void** tmpdata;
-    int num_alloc;
+    uint32_t off;
 
-    /* Check to see the reservation isn't exceeding the hard limit */
-    if (n > max_nodes - st->num)
+    if (st == NULL || st->num == max_nodes || !csk_off(st, data, &off))
     {
         return 0;
     }
 
-    /* Figure out the new size */
-    num_alloc = st->num + n;
-    if (num_alloc < min_nodes)
+    if (!csk_reserve(st, 1, 0))
     {
-        num_alloc = min_nodes;
+        return 0;
     }
 
-    /* If |st->data| allocation was postponed */
-    if (st->data == NULL)
+    if ((loc >= st->num) || (loc < 0))
     {
-        /*
-        * At this point, |st->num_alloc| and |st->num| are 0;
-        * so |num_alloc| value is |n| or |min_nodes| if greater than |n|.
-        */
-        if ((st->data = OPENSSL_zalloc(sizeof(void*) * num_alloc)) == NULL)
-        {
-            //            CRYPTOerr(CRYPTO_F_SK_RESERVE, ERR_R_MALLOC_FAILURE);
-            return 0;
-        }
-        st->num_alloc = num_alloc;
-        return 1;
+        st->data[st->num] = off;
     }
-
-    if (!exact)
+    else
     {
-        if (num_alloc <= st->num_alloc)
-        {
-            return 1;
-        }
-        num_alloc = compute_growth(num_alloc, st->num_alloc);
-        if (num_alloc == 0)
-        {
-            return 0;
-        }
+        memmove(&st->data[loc + 1], &st->data[loc],
+                sizeof(st->data[0]) * (st->num - loc));
+        st->data[loc] = off;
     }
-    else if (num_alloc == st->num_alloc)
+    st->num++;
+    st->sorted = 0;
+    return st->num;
+}
+
+void* OPENSSL_csk_delete(OPENSSL_CSTACK* st, int loc)
+{
+    uint32_t ret;
+
+    if (st == NULL || loc < 0 || loc >= st->num)
     {
-        return 1;
+        return NULL;
     }
 
-    tmpdata = OPENSSL_realloc((void*)st->data, sizeof(void*) * num_alloc);
-    if (tmpdata == NULL)
+    ret = st->data[loc];
+    if (loc != st->num - 1)
+        memmove(&st->data[loc], &st->data[loc + 1],
+                sizeof(st->data[0]) * (st->num - loc - 1));
+    st->num--;
+    return (void*)csk_ptr(st, ret);
+}
+
+int OPENSSL_csk_push(OPENSSL_CSTACK* st, const void* data)
+{
+    if (st == NULL)
     {
-        return 0;
+        return -1;
     }
+    return OPENSSL_csk_insert(st, data, st->num);
+}
 
-    st->data = tmpdata;
-    st->num_alloc = num_alloc;
-    return 1;
+int OPENSSL_csk_unshift(OPENSSL_CSTACK* st, const void* data)
+{
+    return OPENSSL_csk_insert(st, data, 0);
 }
 
-OPENSSL_STACK* OPENSSL_sk_new_reserve(OPENSSL_sk_compfunc c, int n)
+void* OPENSSL_csk_shift(OPENSSL_CSTACK* st)
 {
-    OPENSSL_STACK* st = OPENSSL_zalloc(sizeof(OPENSSL_STACK));
+    return OPENSSL_csk_delete(st, 0);
+}
 
+void* OPENSSL_csk_pop(OPENSSL_CSTACK* st)
+{
     if (st == NULL)
     {
         return NULL;
     }
+    return OPENSSL_csk_delete(st, st->num - 1);
+}
+
+/* No memset needed: the slots past |num| are never read */
+void OPENSSL_csk_zero(OPENSSL_CSTACK* st)
+{
+    if (st == NULL)
+    {
+        return;
+    }
+    st->num = 0;
+}
+
+OPENSSL_sk_compfunc OPENSSL_csk_set_cmp_func(OPENSSL_CSTACK* st,
+        OPENSSL_sk_compfunc c)
+{
+    OPENSSL_sk_compfunc old = st->comp;
 
+    if (st->comp != c)
+    {
+        st->sorted = 0;
+    }
     st->comp = c;
 
-    if (n <= 0)
+    return old;
+}
+
+/*
+* qsort() cannot pass the arena base to a comparison function, so the
+* elements are decompressed into a temporary pointer array, sorted with the
+* comparison function as is, and compressed back.  Without memory for it
+* the stack stays unsorted and finds scan it linearly.
+*/
+void OPENSSL_csk_sort(OPENSSL_CSTACK* st)
+{
+    const void** tmp;
+    int i;
+
+    if (st == NULL || st->sorted || st->comp == NULL)
     {
-        return st;
+        return;
+    }
+    if (st->num > 1)
+    {
+        tmp = (const void**)OPENSSL_malloc(sizeof(*tmp) * st->num);
+        if (tmp == NULL)
+        {
+            return;
+        }
+        for (i = 0; i < st->num; i++)
+        {
+            tmp[i] = csk_ptr(st, st->data[i]);
+        }
+        qsort((void*)tmp, st->num, sizeof(*tmp), st->comp);
+        for (i = 0; i < st->num; i++)
+        {
+            csk_off(st, tmp[i], &st->data[i]);
+        }
+        OPENSSL_free((void*)tmp);
     }
+    st->sorted = 1; /* empty or single-element stack is considered sorted */
+}
 
-    if (!sk_reserve(st, n, 1))
+int OPENSSL_csk_is_sorted(const OPENSSL_CSTACK* st)
+{
+    return st == NULL ? 1 : st->sorted;
+}
+
+/* Same results as OBJ_bsearch_ex_() on the decompressed elements */
+static int internal_cfind(OPENSSL_CSTACK* st, const void* data,
+                          int ret_val_options)
+{
+    uint32_t off;
+    int i;
+
+    if (st == NULL || st->num == 0)
     {
-        OPENSSL_sk_free(st);
-        return NULL;
+        return -1;
+    }
+
+    if (st->comp == NULL)
+    {
+        if (!csk_off(st, data, &off))
+        {
+            return -1;
+        }
+        for (i = 0; i < st->num; i++)
+            if (st->data[i] == off)
+            {
+                return i;
+            }
+        return -1;
+    }
+
+    OPENSSL_csk_sort(st);
+    if (data == NULL)
+    {
+        return -1;
+    }
+    if (!st->sorted)
+    {
+        for (i = 0; i < st->num; i++)
+            if (csk_cmp(st, st->comp, data, st->data[i]) == 0)
+            {
+                return i;
+            }
+        return -1;
     }
+    return csk_bsearch(st, data, st->comp, ret_val_options);
+}
 
-    return st;
+int OPENSSL_csk_find(OPENSSL_CSTACK* st, const void* data)
+{
+    return internal_cfind(st, data, OBJ_BSEARCH_FIRST_VALUE_ON_MATCH);
 }
 
-int OPENSSL_sk_reserve(OPENSSL_STACK* st, int n)
+int OPENSSL_csk_find_ex(OPENSSL_CSTACK* st, const void* data)
 {
-    if (st == NULL)
-    {
-        return 0;
-    }
+    return internal_cfind(st, data, OBJ_BSEARCH_VALUE_ON_NOMATCH);
+}
 
-    if (n < 0)
-    {
-        return 1;
-    }
-    return sk_reserve(st, n, 1);
+/* The offsets, for scans that index them directly */
+const uint32_t* OPENSSL_csk_offsets(const OPENSSL_CSTACK* st)
+{
+    return st == NULL ? NULL : st->data;
 }
 
-int OPENSSL_sk_insert(OPENSSL_STACK* st, const void* data, int loc)
+void* OPENSSL_csk_ptr(const OPENSSL_CSTACK* st, uint32_t off)
 {
-    if (st == NULL || st->num == max_nodes)
-    {
-        return 0;
-    }
+    return st == NULL ? NULL : (void*)csk_ptr(st, off);
+}
 
-    if (!sk_reserve(st, 1, 0))
+/*
+* OBJ_bsearch_ex_() with a STACK_OF comparison function, for lookups by a
+* key other than the one |st| is kept sorted with.  |st| is not sorted here.
+*/
+int OPENSSL_csk_bsearch(const OPENSSL_CSTACK* st, const void* key,
+                        OPENSSL_sk_compfunc cmp, int flags)
+{
+    if (st == NULL || cmp == NULL || key == NULL || st->num == 0)
     {
-        return 0;
+        return -1;
     }
+    return csk_bsearch(st, key, cmp, flags);
+}
 
-    if ((loc >= st->num) || (loc < 0))
-    {
-        st->data[st->num] = data;
-    }
-    else
-    {
-        memmove((void*)&st->data[loc + 1], (const void*)&st->data[loc],
-                sizeof(st->data[0]) * (st->num - loc));
-        st->data[loc] = data;
-    }
-    st->num++;
-    st->sorted = 0;
-    return st->num;
+/*-
+* OBJ_NAME registry: (type, name) -> data, in an open-addressing hash table
+* with linear probing and the hash of each entry cached next to it.  Names
+* and data are not copied, they must outlive their registration.  An entry
+* added with OBJ_NAME_ALIAS in its type is an alias: its data is the name
+* of another entry of the same type, which OBJ_NAME_get() follows.
+*
+* OBJ_NAME_freeze() additionally builds a minimal perfect hash of the
+* current entries (hash and displace: every bucket of about two keys gets a
+* seed that sends its keys to free slots), so that a lookup is one seed
+* read, one slot read and one name comparison.  Any later change drops the
+* frozen index until OBJ_NAME_freeze() is called again.
+*/
+#define OBJ_NAME_MIN_SLOTS      64
+#define OBJ_NAME_MAX_ALIASES    10
+#define OBJ_NAME_MPH_MAX_SEED   (1U << 20)
+
+typedef struct obj_name_slot_st
+{
+    OBJ_NAME on;                /* on.name == NULL for an empty slot */
+    uint64_t hash;
+} OBJ_NAME_SLOT;
+
+static struct
+{
+    OBJ_NAME_SLOT* slots;
+    size_t mask;                /* number of slots - 1, a power of 2 */
+    size_t count;
+    int frozen;
+    OBJ_NAME_SLOT* mph_slots;   /* frozen index, |mph_n| entries */
+    uint32_t* mph_seeds;        /* one per bucket */
+    uint32_t mph_n;
+    uint32_t mph_buckets;
+} obj_names;
+
+#ifdef OPENSSL_THREADS
+static pthread_mutex_t obj_names_lock = PTHREAD_MUTEX_INITIALIZER;
+# define OBJ_NAME_LOCK()        pthread_mutex_lock(&obj_names_lock)
+# define OBJ_NAME_UNLOCK()      pthread_mutex_unlock(&obj_names_lock)
+#else
+# define OBJ_NAME_LOCK()        ((void)0)
+# define OBJ_NAME_UNLOCK()      ((void)0)
+#endif
+
+static uint64_t obj_name_hash(const char* name, int type)
+{
+    return ossl_hash64(name, strlen(name))
+           + (uint64_t)(unsigned int)type * 0x9e3779b97f4a7c15ULL;
 }
 
-static ossl_inline void* internal_delete(OPENSSL_STACK* st, int loc)
+/* Maps |x| to [0, n) without a division */
+static ossl_inline uint32_t obj_name_reduce(uint32_t x, uint32_t n)
 {
-    const void* ret = st->data[loc];
+    return (uint32_t)(((uint64_t)x * n) >> 32);
+}
 
-    if (loc != st->num - 1)
-        memmove((void*)&st->data[loc], (const void*)&st->data[loc + 1],
-                sizeof(st->data[0]) * (st->num - loc - 1));
-    st->num--;
+/* Slot of a key in the frozen index, given the seed of its bucket */
+static ossl_inline uint32_t obj_name_mph_slot(uint64_t hash, uint32_t seed,
+        uint32_t n)
+{
+    uint64_t x = hash ^ ((uint64_t)seed * 0xc2b2ae3d27d4eb4fULL);
 
-    return (void*)ret;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return obj_name_reduce((uint32_t)(x >> 32), n);
 }
 
-void* OPENSSL_sk_delete_ptr(OPENSSL_STACK* st, const void* p)
+/* The slot holding (|type|, |name|), or the empty slot where it would go */
+static OBJ_NAME_SLOT* obj_name_probe(OBJ_NAME_SLOT* slots, size_t mask,
+                                     const char* name, int type,
+                                     uint64_t hash)
 {
-    int i;
+    OBJ_NAME_SLOT* s;
+    size_t i;
 
-    for (i = 0; i < st->num; i++)
-        if (st->data[i] == p)
+    for (i = (size_t)hash & mask;; i = (i + 1) & mask)
+    {
+        s = &slots[i];
+        if (s->on.name == NULL
+            || (s->hash == hash && s->on.type == type
+                && strcmp(s->on.name, name) == 0))
         {
-            return internal_delete(st, i);
+            return s;
         }
-    return NULL;
+    }
 }
 
-void* OPENSSL_sk_delete(OPENSSL_STACK* st, int loc)
+static const OBJ_NAME* obj_name_lookup(const char* name, int type)
 {
-    if (st == NULL || loc < 0 || loc >= st->num)
+    const OBJ_NAME_SLOT* s;
+    uint64_t hash;
+
+    if (obj_names.count == 0)
     {
         return NULL;
     }
+    hash = obj_name_hash(name, type);
+    if (obj_names.frozen)
+    {
+        s = &obj_names.mph_slots[obj_name_mph_slot(hash,
+                                 obj_names.mph_seeds[obj_name_reduce((uint32_t)hash,
+                                         obj_names.mph_buckets)],
+                                 obj_names.mph_n)];
+        if (s->hash != hash || s->on.type != type
+            || strcmp(s->on.name, name) != 0)
+        {
+            return NULL;
+        }
+        return &s->on;
+    }
+    s = obj_name_probe(obj_names.slots, obj_names.mask, name, type, hash);
+    return s->on.name == NULL ? NULL : &s->on;
+}
 
-    return internal_delete(st, loc);
+static void obj_name_thaw(void)
+{
+    OPENSSL_free(obj_names.mph_slots);
+    OPENSSL_free(obj_names.mph_seeds);
+    obj_names.mph_slots = NULL;
+    obj_names.mph_seeds = NULL;
+    obj_names.mph_n = obj_names.mph_buckets = 0;
+    obj_names.frozen = 0;
 }
 
-static int internal_find(OPENSSL_STACK* st, const void* data,
-                         int ret_val_options)
+/* Makes room for one more entry, keeping the table at most half full */
+static int obj_name_reserve(void)
 {
-    const void* r;
-    int i;
+    OBJ_NAME_SLOT* slots, *s;
+    size_t i, n, mask;
 
-    if (st == NULL || st->num == 0)
+    if (obj_names.slots != NULL && obj_names.count + 1 <= obj_names.mask / 2)
     {
-        return -1;
+        return 1;
     }
-
-    if (st->comp == NULL)
+    n = obj_names.slots == NULL ? OBJ_NAME_MIN_SLOTS
+        : (obj_names.mask + 1) * 2;
+    if (n > SIZE_MAX / sizeof(*slots)
+        || (slots = (OBJ_NAME_SLOT*)OPENSSL_zalloc(sizeof(*slots) * n)) == NULL)
     {
-        for (i = 0; i < st->num; i++)
-            if (st->data[i] == data)
+        return 0;
+    }
+    mask = n - 1;
+    if (obj_names.slots != NULL)
+    {
+        for (i = 0; i <= obj_names.mask; i++)
+        {
+            s = &obj_names.slots[i];
+            if (s->on.name != NULL)
             {
-                return i;
+                *obj_name_probe(slots, mask, s->on.name, s->on.type,
+                                s->hash) = *s;
             }
-        return -1;
+        }
+        OPENSSL_free(obj_names.slots);
     }
+    obj_names.slots = slots;
+    obj_names.mask = mask;
+    return 1;
+}
 
-    if (!st->sorted)
+/*
+* Empties slot |i| and shifts back the entries after it in its cluster that
+* would no longer be reachable from their home slot.
+*/
+static void obj_name_delete_slot(size_t i)
+{
+    OBJ_NAME_SLOT* slots = obj_names.slots;
+    size_t j, home, mask = obj_names.mask;
+
+    for (j = (i + 1) & mask; slots[j].on.name != NULL; j = (j + 1) & mask)
     {
-        if (st->num > 1)
+        home = (size_t)slots[j].hash & mask;
+        /* leave |j| in place if its home lies cyclically in (i, j] */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
         {
-            qsort((void*)st->data, st->num, sizeof(void*), st->comp);
+            continue;
         }
-        st->sorted = 1; /* empty or single-element stack is considered sorted */
+        slots[i] = slots[j];
+        i = j;
     }
-    if (data == NULL)
-    {
-        return -1;
-    }
-    r = OBJ_bsearch_ex_(&data, st->data, st->num, sizeof(void*), st->comp,
-                        ret_val_options);
-
-    return r == NULL ? -1 : (int)((const void**)r - st->data);
+    slots[i].on.name = NULL;
+    obj_names.count--;
 }
 
-int OPENSSL_sk_find(OPENSSL_STACK* st, const void* data)
+int OBJ_NAME_init(void)
 {
-    return internal_find(st, data, OBJ_BSEARCH_FIRST_VALUE_ON_MATCH);
-}
+    int ret;
 
-int OPENSSL_sk_find_ex(OPENSSL_STACK* st, const void* data)
-{
-    return internal_find(st, data, OBJ_BSEARCH_VALUE_ON_NOMATCH);
+    OBJ_NAME_LOCK();
+    ret = obj_name_reserve();
+    OBJ_NAME_UNLOCK();
+    return ret;
 }
 
-int OPENSSL_sk_push(OPENSSL_STACK* st, const void* data)
+/*
+* Returns the data registered for |name| in namespace |type|, following up
+* to OBJ_NAME_MAX_ALIASES aliases.  With OBJ_NAME_ALIAS in |type|, aliases
+* are not followed and the data of an alias is the name it stands for.
+*/
+const char* OBJ_NAME_get(const char* name, int type)
 {
-    if (st == NULL)
+    const OBJ_NAME* on;
+    const char* ret = NULL;
+    int alias, num = 0;
+
+    if (name == NULL)
     {
-        return -1;
+        return NULL;
     }
-    return OPENSSL_sk_insert(st, data, st->num);
-}
+    alias = type & OBJ_NAME_ALIAS;
+    type &= ~OBJ_NAME_ALIAS;
 
-int OPENSSL_sk_unshift(OPENSSL_STACK* st, const void* data)
-{
-    return OPENSSL_sk_insert(st, data, 0);
+    OBJ_NAME_LOCK();
+    for (;;)
+    {
+        if ((on = obj_name_lookup(name, type)) == NULL)
+        {
+            break;
+        }
+        if (!on->alias || alias)
+        {
+            ret = on->data;
+            break;
+        }
+        if (++num > OBJ_NAME_MAX_ALIASES)
+        {
+            break;
+        }
+        name = on->data;
+    }
+    OBJ_NAME_UNLOCK();
+    return ret;
 }
 
-void* OPENSSL_sk_shift(OPENSSL_STACK* st)
+/*
+* Registers |data| under (|type|, |name|), replacing any previous entry.
+* Returns 1 on success and 0 on error.
+*/
+int OBJ_NAME_add(const char* name, int type, const char* data)
 {
-    if (st == NULL || st->num == 0)
+    OBJ_NAME_SLOT* s;
+    uint64_t hash;
+    int alias, ret = 0;
+
+    if (name == NULL)
     {
-        return NULL;
+        return 0;
     }
-    return internal_delete(st, 0);
-}
+    alias = type & OBJ_NAME_ALIAS;
+    type &= ~OBJ_NAME_ALIAS;
+    hash = obj_name_hash(name, type);
 
-void* OPENSSL_sk_pop(OPENSSL_STACK* st)
-{
-    if (st == NULL || st->num == 0)
+    OBJ_NAME_LOCK();
+    if (obj_name_reserve())
     {
-        return NULL;
+        s = obj_name_probe(obj_names.slots, obj_names.mask, name, type, hash);
+        if (s->on.name == NULL)
+        {
+            obj_names.count++;
+        }
+        s->on.type = type;
+        s->on.alias = alias;
+        s->on.name = name;
+        s->on.data = data;
+        s->hash = hash;
+        obj_name_thaw();
+        ret = 1;
     }
-    return internal_delete(st, st->num - 1);
+    OBJ_NAME_UNLOCK();
+    return ret;
 }
 
-void OPENSSL_sk_zero(OPENSSL_STACK* st)
+/* Returns 1 if (|type|, |name|) was registered and has been removed */
+int OBJ_NAME_remove(const char* name, int type)
 {
-    if (st == NULL || st->num == 0)
+    OBJ_NAME_SLOT* s;
+    int ret = 0;
+
+    if (name == NULL)
     {
-        return;
+        return 0;
     }
-    memset((void*)st->data, 0, sizeof(*st->data) * st->num);
-    st->num = 0;
+    type &= ~OBJ_NAME_ALIAS;
+
+    OBJ_NAME_LOCK();
+    if (obj_names.count > 0)
+    {
+        s = obj_name_probe(obj_names.slots, obj_names.mask, name, type,
+                           obj_name_hash(name, type));
+        if (s->on.name != NULL)
+        {
+            obj_name_delete_slot((size_t)(s - obj_names.slots));
+            obj_name_thaw();
+            ret = 1;
+        }
+    }
+    OBJ_NAME_UNLOCK();
+    return ret;
 }
 
-void OPENSSL_sk_pop_free(OPENSSL_STACK* st, OPENSSL_sk_freefunc func)
+/* Removes the entries of namespace |type|, or all of them if |type| < 0 */
+void OBJ_NAME_cleanup(int type)
 {
-    int i;
+    size_t i;
 
-    if (st == NULL)
+    OBJ_NAME_LOCK();
+    obj_name_thaw();
+    if (type < 0)
     {
-        return;
+        OPENSSL_free(obj_names.slots);
+        obj_names.slots = NULL;
+        obj_names.mask = 0;
+        obj_names.count = 0;
     }
-    for (i = 0; i < st->num; i++)
-        if (st->data[i] != NULL)
+    else if (obj_names.slots != NULL)
+    {
+        type &= ~OBJ_NAME_ALIAS;
+        for (i = 0; i <= obj_names.mask; i++)
         {
-            func((char*)st->data[i]);
+            /* deleting shifts a later entry into |i|, so look at it again */
+            while (obj_names.slots[i].on.name != NULL
+                   && obj_names.slots[i].on.type == type)
+            {
+                obj_name_delete_slot(i);
+            }
         }
-    OPENSSL_sk_free(st);
+    }
+    OBJ_NAME_UNLOCK();
 }
 
-void OPENSSL_sk_free(OPENSSL_STACK* st)
+/*
+* Calls |fn| on every entry of namespace |type|, in no particular order.
+* |fn| must not change the registry.
+*/
+void OBJ_NAME_do_all(int type, void (*fn)(const OBJ_NAME*, void* arg),
+                     void* arg)
 {
-    if (st == NULL)
+    size_t i;
+
+    type &= ~OBJ_NAME_ALIAS;
+    OBJ_NAME_LOCK();
+    for (i = 0; obj_names.slots != NULL && i <= obj_names.mask; i++)
     {
-        return;
+        if (obj_names.slots[i].on.name != NULL
+            && obj_names.slots[i].on.type == type)
+        {
+            fn(&obj_names.slots[i].on, arg);
+        }
     }
-    OPENSSL_free((void*)st->data);
-    OPENSSL_free((void*)st);
+    OBJ_NAME_UNLOCK();
 }
 
-int OPENSSL_sk_num(const OPENSSL_STACK* st)
+static int obj_name_cmp_name(const void* a, const void* b)
 {
-    return st == NULL ? -1 : st->num;
+    return strcmp(((const OBJ_NAME*)a)->name, ((const OBJ_NAME*)b)->name);
 }
 
-void* OPENSSL_sk_value(const OPENSSL_STACK* st, int i)
+/*
+* Calls |fn| on a snapshot of the entries of namespace |type|, sorted by
+* name.  |fn| may change the registry.
+*/
+void OBJ_NAME_do_all_sorted(int type,
+                            void (*fn)(const OBJ_NAME*, void* arg),
+                            void* arg)
 {
-    if (st == NULL || i < 0 || i >= st->num)
+    OBJ_NAME* names = NULL;
+    size_t i, n = 0;
+
+    type &= ~OBJ_NAME_ALIAS;
+    OBJ_NAME_LOCK();
+    if (obj_names.count > 0
+        && (names = (OBJ_NAME*)OPENSSL_malloc(sizeof(*names)
+                                              * obj_names.count)) != NULL)
     {
-        return NULL;
+        for (i = 0; i <= obj_names.mask; i++)
+        {
+            if (obj_names.slots[i].on.name != NULL
+                && obj_names.slots[i].on.type == type)
+            {
+                names[n++] = obj_names.slots[i].on;
+            }
+        }
     }
-    return (void*)st->data[i];
-}
+    OBJ_NAME_UNLOCK();
 
-void* OPENSSL_sk_set(OPENSSL_STACK* st, int i, const void* data)
-{
-    if (st == NULL || i < 0 || i >= st->num)
+    if (n > 1)
     {
-        return NULL;
+        qsort(names, n, sizeof(*names), obj_name_cmp_name);
     }
-    st->data[i] = data;
-    st->sorted = 0;
-    return (void*)st->data[i];
+    for (i = 0; i < n; i++)
+    {
+        fn(&names[i], arg);
+    }
+    OPENSSL_free(names);
 }
 
-void OPENSSL_sk_sort(OPENSSL_STACK* st)
+/* Orders buckets by decreasing size; the size is in the high 32 bits */
+static int obj_name_cmp_bucket(const void* a, const void* b)
 {
-    if (st != NULL && !st->sorted && st->comp != NULL)
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return (x < y) - (x > y);
+}
+
+/* Builds the frozen index over the current entries, called locked */
+static int obj_name_build_mph(void)
+{
+    OBJ_NAME_SLOT* keys = NULL, *out = NULL;
+    uint32_t* seeds = NULL, *start = NULL, *members = NULL, *pos = NULL;
+    uint64_t* order = NULL;
+    unsigned char* used = NULL;
+    uint32_t n, r, b, i, j, k, seed, size;
+    size_t s;
+    int ret = 0;
+
+    if (obj_names.count > 0xffffffffU / 2)
     {
-        if (st->num > 1)
+        return 0;
+    }
+    n = (uint32_t)obj_names.count;
+    r = n / 2 + 1;
+    keys = (OBJ_NAME_SLOT*)OPENSSL_malloc(sizeof(*keys) * n);
+    out = (OBJ_NAME_SLOT*)OPENSSL_malloc(sizeof(*out) * n);
+    seeds = (uint32_t*)OPENSSL_zalloc(sizeof(*seeds) * r);
+    start = (uint32_t*)OPENSSL_zalloc(sizeof(*start) * (r + 1));
+    members = (uint32_t*)OPENSSL_malloc(sizeof(*members) * n);
+    pos = (uint32_t*)OPENSSL_zalloc(sizeof(*pos) * n);
+    order = (uint64_t*)OPENSSL_malloc(sizeof(*order) * r);
+    used = (unsigned char*)OPENSSL_zalloc(n);
+    if (keys == NULL || out == NULL || seeds == NULL || start == NULL
+        || members == NULL || pos == NULL || order == NULL || used == NULL)
+    {
+        goto end;
+    }
+
+    /* bucket the keys, as start[] offsets into members[] */
+    for (s = 0, i = 0; s <= obj_names.mask; s++)
+    {
+        if (obj_names.slots[s].on.name != NULL)
         {
-            qsort((void*)st->data, st->num, sizeof(void*), (int(*)(const void*, const void*))st->comp);
+            keys[i] = obj_names.slots[s];
+            start[obj_name_reduce((uint32_t)keys[i].hash, r) + 1]++;
+            i++;
+        }
+    }
+    for (b = 0; b < r; b++)
+    {
+        order[b] = ((uint64_t)start[b + 1] << 32) | b;
+        start[b + 1] += start[b];
+    }
+    for (i = 0; i < n; i++)
+    {
+        b = obj_name_reduce((uint32_t)keys[i].hash, r);
+        members[start[b] + pos[b]] = i;
+        pos[b]++;
+    }
+    qsort(order, r, sizeof(*order), obj_name_cmp_bucket);
+
+    /* place the largest buckets first, while the table is still empty */
+    for (k = 0; k < r && (size = (uint32_t)(order[k] >> 32)) > 0; k++)
+    {
+        b = (uint32_t)order[k];
+        for (seed = 0; seed < OBJ_NAME_MPH_MAX_SEED; seed++)
+        {
+            for (j = 0; j < size; j++)
+            {
+                pos[j] = obj_name_mph_slot(keys[members[start[b] + j]].hash,
+                                           seed, n);
+                if (used[pos[j]])
+                {
+                    break;
+                }
+                used[pos[j]] = 1;
+            }
+            if (j == size)
+            {
+                break;
+            }
+            while (j-- > 0)
+            {
+                used[pos[j]] = 0;
+            }
+        }
+        if (seed == OBJ_NAME_MPH_MAX_SEED)
+        {
+            goto end;
+        }
+        seeds[b] = seed;
+        for (j = 0; j < size; j++)
+        {
+            out[pos[j]] = keys[members[start[b] + j]];
         }
-        st->sorted = 1; /* empty or single-element stack is considered sorted */
     }
+
+    obj_names.mph_slots = out;
+    obj_names.mph_seeds = seeds;
+    obj_names.mph_n = n;
+    obj_names.mph_buckets = r;
+    obj_names.frozen = 1;
+    out = NULL;
+    seeds = NULL;
+    ret = 1;
+end:
+    OPENSSL_free(keys);
+    OPENSSL_free(out);
+    OPENSSL_free(seeds);
+    OPENSSL_free(start);
+    OPENSSL_free(members);
+    OPENSSL_free(pos);
+    OPENSSL_free(order);
+    OPENSSL_free(used);
+    return ret;
 }
 
-int OPENSSL_sk_is_sorted(const OPENSSL_STACK* st)
+/*
+* Freezes the current entries into a minimal perfect hash for O(1) lookups.
+* Returns 0 if the index could not be built, lookups then keep using the
+* hash table.
+*/
+int OBJ_NAME_freeze(void)
 {
-    return st == NULL ? 1 : st->sorted;
+    int ret = 1;
+
+    OBJ_NAME_LOCK();
+    if (!obj_names.frozen && obj_names.count > 0)
+    {
+        ret = obj_name_build_mph();
+    }
+    OBJ_NAME_UNLOCK();
+    return ret;
 }
 
 #endif /* _OPENSSL_STACK_STANDALONE__H_ */
\ No newline at end of file
@@ -0,0 +1,533 @@
+/*
+C++ wrapper for the standalone openssl stack header
+
+ossl::stack<T> owns an OPENSSL_STACK holding T* elements. It frees the stack
+(and optionally the elements) on destruction, moves by stealing the stack
+pointer, and exposes |st->data| as a random-access range of T* so that the
+standard algorithms work directly on it with inlined comparators.
+
+https://github.com/David-Reguera-Garcia-Dreg/openssl_stack_standalone
+*/
+
+/*
+* Copyright 1995-2018 The OpenSSL Project Authors. All Rights Reserved.
+*
+* Licensed under the OpenSSL license (the "License").  You may not use
+* this file except in compliance with the License.  You can obtain a copy
+* in the file LICENSE in the source distribution or at
+* https://www.openssl.org/source/license.html
+*/
+
+
+#ifndef _OPENSSL_STACK_STANDALONE__HPP_
+#define _OPENSSL_STACK_STANDALONE__HPP_
+
+#include "openssl_stack_standalone.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace ossl
+{
+
+/*
+* Element deleters.  |no_delete| gives sk_free() semantics: the elements are
+* not owned.  |c_delete| wraps a C free function such as the ones passed to
+* sk_TYPE_pop_free(), and std::default_delete<T> suits elements created by
+* emplace_back().
+*/
+struct no_delete
+{
+    template <class T>
+    void operator()(T*) const
+    {
+    }
+};
+
+template <class T, void (*F)(T*)>
+struct c_delete
+{
+    void operator()(T* p) const
+    {
+        F(p);
+    }
+};
+
+template <class T, class Deleter = no_delete>
+class stack
+{
+public:
+    typedef T* value_type;
+    typedef T*& reference;
+    typedef T* const& const_reference;
+    typedef T** iterator;
+    class const_iterator;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef int (*compfunc)(const T* const*, const T* const*);
+
+    /* The underlying OPENSSL_STACK is allocated lazily, on first insertion */
+    stack() noexcept : st_(NULL)
+    {
+    }
+
+    explicit stack(compfunc cmp)
+        : st_(OPENSSL_sk_new((OPENSSL_sk_compfunc)cmp))
+    {
+        if (st_ == NULL)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    /* Takes ownership of |st|, e.g. a STACK_OF(TYPE) built by C code */
+    explicit stack(OPENSSL_STACK* st) noexcept : st_(st)
+    {
+    }
+
+    stack(const stack&) = delete;
+    stack& operator=(const stack&) = delete;
+
+    stack(stack&& other) noexcept : st_(other.st_)
+    {
+        other.st_ = NULL;
+    }
+
+    stack& operator=(stack&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset(other.st_);
+            other.st_ = NULL;
+        }
+        return *this;
+    }
+
+    ~stack()
+    {
+        reset();
+    }
+
+    /* Frees the current stack and its owned elements, then adopts |st| */
+    void reset(OPENSSL_STACK* st = NULL) noexcept
+    {
+        OPENSSL_STACK* old = st_;
+
+        st_ = st;
+        if (old == NULL)
+        {
+            return;
+        }
+        sk_flatten(old);
+        for (int i = 0; i < old->num; i++)
+            if (old->data[i] != NULL)
+            {
+                Deleter()((T*)old->data[i]);
+            }
+        OPENSSL_sk_free(old);
+    }
+
+    /* Gives up ownership; the caller must sk_free() the result */
+    OPENSSL_STACK* release() noexcept
+    {
+        OPENSSL_STACK* st = st_;
+
+        st_ = NULL;
+        return st;
+    }
+
+    OPENSSL_STACK* get() const noexcept
+    {
+        return st_;
+    }
+
+    /* For the typed C wrappers: sk_TYPE_num(s.get_as<STACK_OF(TYPE)>()) */
+    template <class S>
+    S* get_as() const noexcept
+    {
+        return reinterpret_cast<S*>(st_);
+    }
+
+    void swap(stack& other) noexcept
+    {
+        std::swap(st_, other.st_);
+    }
+
+    size_type size() const noexcept
+    {
+        return st_ == NULL ? 0 : (size_type)st_->num;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    size_type capacity() const noexcept
+    {
+        return st_ == NULL ? 0 : (size_type)st_->num_alloc;
+    }
+
+    /* Unlike sk_reserve(), |n| is the total capacity, as for std::vector */
+    void reserve(size_type n)
+    {
+        if (n <= capacity())
+        {
+            return;
+        }
+        if (n > (size_type)INT_MAX)
+        {
+            throw std::length_error("ossl::stack::reserve");
+        }
+        if (st_ == NULL)
+        {
+            if ((st_ = OPENSSL_sk_new_reserve(NULL, (int)n)) == NULL)
+            {
+                throw std::bad_alloc();
+            }
+            return;
+        }
+        if (!OPENSSL_sk_reserve(st_, (int)n - st_->num))
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    /*
+    * Writable iterators are plain pointers, so a chunked stack is made
+    * contiguous first (see sk_set_chunked()).  Read-only ones and the
+    * element accessors below go through the slots and leave the stack as
+    * it is.
+    */
+    iterator begin() noexcept
+    {
+        sk_flatten(st_);
+        return st_ == NULL ? NULL : (T**)st_->data;
+    }
+
+    iterator end() noexcept
+    {
+        sk_flatten(st_);
+        return st_ == NULL ? NULL : (T**)st_->data + st_->num;
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return const_iterator(st_, 0);
+    }
+
+    const_iterator end() const noexcept
+    {
+        return const_iterator(st_, (int)size());
+    }
+
+    const_iterator cbegin() const noexcept
+    {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept
+    {
+        return end();
+    }
+
+    /*
+    * Unchecked element access.  Writing through the reference bypasses
+    * sk_set(), so call mark_unsorted() afterwards if the stack has a
+    * comparison function.
+    */
+    reference operator[](size_type i) noexcept
+    {
+        return *(T**)sk_slot(st_, (int)i);
+    }
+
+    const_reference operator[](size_type i) const noexcept
+    {
+        return *(T* const*)sk_slot(st_, (int)i);
+    }
+
+    reference at(size_type i)
+    {
+        if (i >= size())
+        {
+            throw std::out_of_range("ossl::stack::at");
+        }
+        return (*this)[i];
+    }
+
+    const_reference at(size_type i) const
+    {
+        if (i >= size())
+        {
+            throw std::out_of_range("ossl::stack::at");
+        }
+        return (*this)[i];
+    }
+
+    reference front() noexcept
+    {
+        return (*this)[0];
+    }
+
+    reference back() noexcept
+    {
+        return (*this)[size() - 1];
+    }
+
+    /*
+    * Throws std::bad_alloc if the element cannot be added, which growing
+    * the array first makes unlikely but not impossible (a chunked stack
+    * may need a new block), and std::logic_error on an adopted view.
+    */
+    void push_back(T* p)
+    {
+        grow();
+        if (OPENSSL_sk_push(st_, p) <= 0)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    /*
+    * Constructs the element with new, so the stack should own its elements
+    * through std::default_delete<T>.  The element is deleted again if it
+    * cannot be added, see push_back().
+    */
+    template <class... Args>
+    T* emplace_back(Args&&... args)
+    {
+        T* p;
+
+        /* grow first so that the usual failures come before |p| exists */
+        grow();
+        p = new T(std::forward<Args>(args)...);
+        if (OPENSSL_sk_push(st_, p) <= 0)
+        {
+            delete p;
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    /* Removes the last element and hands its ownership to the caller */
+    T* pop() noexcept
+    {
+        return (T*)OPENSSL_sk_pop(st_);
+    }
+
+    compfunc set_cmp_func(compfunc cmp)
+    {
+        if (st_ == NULL && (st_ = OPENSSL_sk_new_null()) == NULL)
+        {
+            throw std::bad_alloc();
+        }
+        return (compfunc)OPENSSL_sk_set_cmp_func(st_,
+                (OPENSSL_sk_compfunc)cmp);
+    }
+
+    /* Sorts with the registered comparison function, see sk_sort() */
+    void sort() noexcept
+    {
+        OPENSSL_sk_sort(st_);
+    }
+
+    /*
+    * Sorts with an arbitrary, inlinable ordering on the element pointers.
+    * The result is only known to agree with the registered comparison
+    * function if the caller says so.
+    */
+    template <class Compare>
+    void sort(Compare comp, bool matches_cmp_func = false)
+    {
+        std::sort(begin(), end(), comp);
+        if (st_ != NULL)
+        {
+            st_->sorted = matches_cmp_func && st_->comp != NULL;
+            st_->gen++;
+        }
+    }
+
+    void mark_unsorted() noexcept
+    {
+        if (st_ != NULL)
+        {
+            st_->sorted = 0;
+            st_->gen++;
+        }
+    }
+
+    bool is_sorted() const noexcept
+    {
+        return OPENSSL_sk_is_sorted(st_) != 0;
+    }
+
+    /* Same result as sk_find(): index of the first match or -1 */
+    int find(T* p) const noexcept
+    {
+        return OPENSSL_sk_find(st_, p);
+    }
+
+private:
+    /* Makes room for one more element, growing by 3/2 like sk_push() */
+    void grow()
+    {
+        size_type n = size();
+
+        if (st_ != NULL && sk_is_view(st_))
+        {
+            throw std::logic_error("ossl::stack: a view is read-only");
+        }
+        if (n < capacity())
+        {
+            return;
+        }
+        reserve(n < 4 ? 4 : n + n / 2);
+    }
+
+    OPENSSL_STACK* st_;
+};
+
+/* Random-access iterator over the slots of a possibly chunked stack */
+template <class T, class Deleter>
+class stack<T, Deleter>::const_iterator
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef T* value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T* const* pointer;
+    typedef T* const& reference;
+
+    const_iterator() noexcept : st_(NULL), i_(0)
+    {
+    }
+
+    const_iterator(const OPENSSL_STACK* st, int i) noexcept : st_(st), i_(i)
+    {
+    }
+
+    reference operator*() const noexcept
+    {
+        return *(T* const*)sk_slot(st_, i_);
+    }
+
+    pointer operator->() const noexcept
+    {
+        return (T* const*)sk_slot(st_, i_);
+    }
+
+    reference operator[](difference_type n) const noexcept
+    {
+        return *(T* const*)sk_slot(st_, i_ + (int)n);
+    }
+
+    const_iterator& operator++() noexcept
+    {
+        ++i_;
+        return *this;
+    }
+
+    const_iterator operator++(int) noexcept
+    {
+        const_iterator it(*this);
+
+        ++i_;
+        return it;
+    }
+
+    const_iterator& operator--() noexcept
+    {
+        --i_;
+        return *this;
+    }
+
+    const_iterator operator--(int) noexcept
+    {
+        const_iterator it(*this);
+
+        --i_;
+        return it;
+    }
+
+    const_iterator& operator+=(difference_type n) noexcept
+    {
+        i_ += (int)n;
+        return *this;
+    }
+
+    const_iterator& operator-=(difference_type n) noexcept
+    {
+        i_ -= (int)n;
+        return *this;
+    }
+
+    const_iterator operator+(difference_type n) const noexcept
+    {
+        return const_iterator(st_, i_ + (int)n);
+    }
+
+    friend const_iterator operator+(difference_type n,
+                                    const const_iterator& it) noexcept
+    {
+        return it + n;
+    }
+
+    const_iterator operator-(difference_type n) const noexcept
+    {
+        return const_iterator(st_, i_ - (int)n);
+    }
+
+    difference_type operator-(const const_iterator& o) const noexcept
+    {
+        return i_ - o.i_;
+    }
+
+    bool operator==(const const_iterator& o) const noexcept
+    {
+        return i_ == o.i_ && st_ == o.st_;
+    }
+
+    bool operator!=(const const_iterator& o) const noexcept
+    {
+        return !(*this == o);
+    }
+
+    bool operator<(const const_iterator& o) const noexcept
+    {
+        return i_ < o.i_;
+    }
+
+    bool operator>(const const_iterator& o) const noexcept
+    {
+        return i_ > o.i_;
+    }
+
+    bool operator<=(const const_iterator& o) const noexcept
+    {
+        return i_ <= o.i_;
+    }
+
+    bool operator>=(const const_iterator& o) const noexcept
+    {
+        return i_ >= o.i_;
+    }
+
+private:
+    const OPENSSL_STACK* st_;
+    int i_;
+};
+
+template <class T, class Deleter>
+inline void swap(stack<T, Deleter>& a, stack<T, Deleter>& b) noexcept
+{
+    a.swap(b);
+}
+
+}
+
+#endif
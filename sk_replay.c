@@ -0,0 +1,507 @@
+/*
+sk_replay: replays an operation trace against the stack header
+
+A trace is recorded by a program built with -DOPENSSL_SK_TRACE (see
+OPENSSL_sk_trace_start()).  It holds no elements, so the replay fills the
+stacks with pointers to random keys and compares them as longs when the
+traced stack had a comparison function.  Before each operation the stack is
+grown or shrunk, untimed, to the size it had when traced; this also covers
+the calls the trace does not record (concat, splice, heap operations...).
+
+Each operation is timed on its own and reported as a latency histogram per
+operation type, so that a storage mode or a tuning change can be compared
+against real traffic:
+
+    sk_replay [-m flat|chunked|stable] [-s] trace
+
+-m picks the mode applied to every replayed stack (see sk_set_chunked() and
+sk_set_stable()), -s prints the summary table only.  The stack pool is a
+build option: build a second sk_replay with -DOPENSSL_NO_SK_POOL to measure
+it.
+*/
+
+#ifndef _POSIX_C_SOURCE
+# define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "openssl_stack_standalone.h"
+
+#include <inttypes.h>
+#include <time.h>
+
+#define NKEYS           (1 << 16)
+#define NBUCKETS        40      /* log2 of the latency in nanoseconds */
+
+enum replay_mode
+{
+    MODE_FLAT,
+    MODE_CHUNKED,
+    MODE_STABLE
+};
+
+static const char* const op_names[OPENSSL_SK_OP_MAX + 1] =
+{
+    NULL, "new", "free", "dup", "reserve", "insert", "delete", "value",
+    "set", "find", "find_ex", "sort", "zero", "num"
+};
+
+typedef struct op_stats_st
+{
+    unsigned long count;
+    uint64_t total;
+    uint64_t max;
+    unsigned long hist[NBUCKETS];
+} OP_STATS;
+
+static long keys[NKEYS];
+static unsigned int next_key;
+static OPENSSL_STACK** stacks;
+static size_t nstacks;
+static enum replay_mode mode = MODE_FLAT;
+static uint64_t timer_overhead;
+static unsigned long resized;   /* elements added or removed to match sizes */
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* The cost of a pair of now() calls, taken off every measurement */
+static uint64_t calibrate(void)
+{
+    uint64_t t, best = (uint64_t)-1;
+    int i;
+
+    for (i = 0; i < 10000; i++)
+    {
+        t = now();
+        t = now() - t;
+        if (t < best)
+        {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static int key_cmp(const void* a, const void* b)
+{
+    long x = **(const long* const*)a;
+    long y = **(const long* const*)b;
+
+    return (x > y) - (x < y);
+}
+
+static void* next_elem(void)
+{
+    return &keys[next_key++ & (NKEYS - 1)];
+}
+
+static void apply_mode(OPENSSL_STACK* st)
+{
+    if (mode == MODE_CHUNKED)
+    {
+        OPENSSL_sk_set_chunked(st, 1);
+    }
+    else if (mode == MODE_STABLE)
+    {
+        OPENSSL_sk_set_stable(st, 1);
+    }
+}
+
+static OPENSSL_STACK** stack_slot(uint32_t id)
+{
+    OPENSSL_STACK** tmp;
+    size_t n;
+
+    if (id >= nstacks)
+    {
+        n = nstacks == 0 ? 64 : nstacks;
+        while (n <= id)
+        {
+            n *= 2;
+        }
+        tmp = (OPENSSL_STACK**)realloc(stacks, n * sizeof(*stacks));
+        if (tmp == NULL)
+        {
+            return NULL;
+        }
+        memset(tmp + nstacks, 0, (n - nstacks) * sizeof(*stacks));
+        stacks = tmp;
+        nstacks = n;
+    }
+    return &stacks[id];
+}
+
+/*
+* The replayed stack |id|, created if the trace has not shown where it came
+* from, with the comparison function and the size of the traced one.
+*/
+static OPENSSL_STACK* stack_get(uint32_t id, int flags, int num)
+{
+    OPENSSL_STACK** slot = stack_slot(id);
+    OPENSSL_STACK* st;
+
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+    if ((st = *slot) == NULL)
+    {
+        if ((st = OPENSSL_sk_new_null()) == NULL)
+        {
+            return NULL;
+        }
+        apply_mode(st);
+        *slot = st;
+    }
+    OPENSSL_sk_set_cmp_func(st, flags & OPENSSL_SK_TRACE_CMP ? key_cmp : NULL);
+    while (OPENSSL_sk_num(st) < num)
+    {
+        if (!OPENSSL_sk_push(st, next_elem()))
+        {
+            return NULL;
+        }
+        resized++;
+    }
+    while (OPENSSL_sk_num(st) > num)
+    {
+        OPENSSL_sk_pop(st);
+        resized++;
+    }
+    return st;
+}
+
+/* Replays |rec|, returns its latency or (uint64_t)-1 if it was skipped */
+static uint64_t replay(const OPENSSL_SK_TRACE_REC* rec)
+{
+    static long missing = LONG_MIN;
+    OPENSSL_STACK** slot;
+    OPENSSL_STACK* st = NULL;
+    OPENSSL_STACK* src;
+    const void* key;
+    uint64_t t = 0;
+
+    switch (rec->op)
+    {
+    case OPENSSL_SK_OP_NEW:
+        if ((slot = stack_slot(rec->stack)) == NULL)
+        {
+            return (uint64_t)-1;
+        }
+        OPENSSL_sk_free(*slot);
+        t = now();
+        *slot = OPENSSL_sk_new_reserve(rec->flags & OPENSSL_SK_TRACE_CMP
+                                       ? key_cmp : NULL, rec->index);
+        t = now() - t;
+        if (*slot != NULL)
+        {
+            apply_mode(*slot);
+        }
+        break;
+    case OPENSSL_SK_OP_FREE:
+        if ((slot = stack_slot(rec->stack)) == NULL || *slot == NULL)
+        {
+            return (uint64_t)-1;
+        }
+        t = now();
+        OPENSSL_sk_free(*slot);
+        t = now() - t;
+        *slot = NULL;
+        break;
+    case OPENSSL_SK_OP_DUP:
+        if ((src = stack_get((uint32_t)rec->index, rec->flags, rec->num))
+            == NULL || (slot = stack_slot(rec->stack)) == NULL)
+        {
+            return (uint64_t)-1;
+        }
+        OPENSSL_sk_free(*slot);
+        t = now();
+        *slot = OPENSSL_sk_dup(src);
+        t = now() - t;
+        break;
+    default:
+        if (rec->op > OPENSSL_SK_OP_MAX
+            || (st = stack_get(rec->stack, rec->flags, rec->num)) == NULL)
+        {
+            return (uint64_t)-1;
+        }
+        break;
+    }
+
+    switch (rec->op)
+    {
+    case OPENSSL_SK_OP_RESERVE:
+        t = now();
+        OPENSSL_sk_reserve(st, rec->index);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_INSERT:
+        key = next_elem();
+        t = now();
+        OPENSSL_sk_insert(st, key, rec->index);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_DELETE:
+        t = now();
+        OPENSSL_sk_delete(st, rec->index);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_VALUE:
+        t = now();
+        OPENSSL_sk_value(st, rec->index);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_SET:
+        key = next_elem();
+        t = now();
+        OPENSSL_sk_set(st, rec->index, key);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_FIND:
+    case OPENSSL_SK_OP_FIND_EX:
+        /* a hit if the traced call found something, otherwise a miss */
+        key = rec->index >= 0 && rec->index < rec->num
+              ? OPENSSL_sk_value(st, rec->index) : &missing;
+        t = now();
+        if (rec->op == OPENSSL_SK_OP_FIND)
+        {
+            OPENSSL_sk_find(st, key);
+        }
+        else
+        {
+            OPENSSL_sk_find_ex(st, key);
+        }
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_SORT:
+        t = now();
+        OPENSSL_sk_sort(st);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_ZERO:
+        t = now();
+        OPENSSL_sk_zero(st);
+        t = now() - t;
+        break;
+    case OPENSSL_SK_OP_NUM:
+        t = now();
+        OPENSSL_sk_num(st);
+        t = now() - t;
+        break;
+    }
+
+    return t > timer_overhead ? t - timer_overhead : 0;
+}
+
+static int bucket(uint64_t ns)
+{
+    int b = 0;
+
+    while (ns > 1 && b < NBUCKETS - 1)
+    {
+        ns >>= 1;
+        b++;
+    }
+    return b;
+}
+
+/* Upper bound of the bucket holding the |pct| percentile */
+static uint64_t percentile(const OP_STATS* s, int pct)
+{
+    unsigned long n = 0, want = (unsigned long)((double)s->count * pct / 100);
+    int b;
+
+    for (b = 0; b < NBUCKETS; b++)
+    {
+        if ((n += s->hist[b]) > want)
+        {
+            break;
+        }
+    }
+    return (uint64_t)1 << (b + 1 < NBUCKETS ? b + 1 : NBUCKETS);
+}
+
+static void report(const OP_STATS* stats, int histograms)
+{
+    const OP_STATS* s;
+    unsigned long most;
+    int op, b, first, last, bar;
+
+    printf("%-10s %10s %10s %10s %10s %12s\n",
+           "op", "count", "mean ns", "p50 ns", "p99 ns", "max ns");
+    for (op = 1; op <= OPENSSL_SK_OP_MAX; op++)
+    {
+        s = &stats[op];
+        if (s->count == 0)
+        {
+            continue;
+        }
+        printf("%-10s %10lu %10.1f %10" PRIu64 " %10" PRIu64 " %12" PRIu64
+               "\n", op_names[op], s->count, (double)s->total / s->count,
+               percentile(s, 50), percentile(s, 99), s->max);
+    }
+    if (!histograms)
+    {
+        return;
+    }
+
+    for (op = 1; op <= OPENSSL_SK_OP_MAX; op++)
+    {
+        s = &stats[op];
+        if (s->count == 0)
+        {
+            continue;
+        }
+        most = 0;
+        first = NBUCKETS;
+        last = 0;
+        for (b = 0; b < NBUCKETS; b++)
+        {
+            if (s->hist[b] == 0)
+            {
+                continue;
+            }
+            if (s->hist[b] > most)
+            {
+                most = s->hist[b];
+            }
+            if (b < first)
+            {
+                first = b;
+            }
+            last = b;
+        }
+        printf("\n%s\n", op_names[op]);
+        for (b = first; b <= last; b++)
+        {
+            bar = (int)((s->hist[b] * 50 + most - 1) / most);
+            printf("  < %12" PRIu64 " ns %10lu %.*s\n",
+                   (uint64_t)1 << (b + 1), s->hist[b], bar,
+                   "##################################################");
+        }
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: sk_replay [-m flat|chunked|stable] [-s] trace\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static OP_STATS stats[OPENSSL_SK_OP_MAX + 1];
+    const char* path = NULL;
+    char magic[OPENSSL_SK_TRACE_MAGIC_LEN];
+    OPENSSL_SK_TRACE_REC rec;
+    unsigned long nrec = 0, skipped = 0;
+    uint64_t t, span = 0, start;
+    uint32_t seed = 2463534242U;
+    int i, histograms = 1;
+    size_t n;
+    FILE* f;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "flat") == 0)
+            {
+                mode = MODE_FLAT;
+            }
+            else if (strcmp(argv[i], "chunked") == 0)
+            {
+                mode = MODE_CHUNKED;
+            }
+            else if (strcmp(argv[i], "stable") == 0)
+            {
+                mode = MODE_STABLE;
+            }
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            histograms = 0;
+        }
+        else if (path == NULL && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (path == NULL)
+    {
+        usage();
+        return 1;
+    }
+
+    if ((f = fopen(path, "rb")) == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+        || memcmp(magic, OPENSSL_SK_TRACE_MAGIC, sizeof(magic)) != 0)
+    {
+        fprintf(stderr, "%s: not a stack trace\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    /* random keys, above the |missing| key used for failed finds */
+    for (i = 0; i < NKEYS; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        keys[i] = (long)(seed & 0x7fffffff);
+    }
+    timer_overhead = calibrate();
+
+    start = now();
+    while ((n = fread(&rec, sizeof(rec), 1, f)) == 1)
+    {
+        nrec++;
+        span = rec.time;
+        if ((t = replay(&rec)) == (uint64_t)-1)
+        {
+            skipped++;
+            continue;
+        }
+        stats[rec.op].count++;
+        stats[rec.op].total += t;
+        if (t > stats[rec.op].max)
+        {
+            stats[rec.op].max = t;
+        }
+        stats[rec.op].hist[bucket(t)]++;
+    }
+    t = now() - start;
+    fclose(f);
+
+    printf("%lu records, %lu skipped, %lu elements resized, trace %.3f s, "
+           "replay %.3f s, mode %s\n\n", nrec, skipped, resized,
+           (double)span / 1e9, (double)t / 1e9,
+           mode == MODE_CHUNKED ? "chunked"
+           : mode == MODE_STABLE ? "stable" : "flat");
+    report(stats, histograms);
+
+    for (n = 0; n < nstacks; n++)
+    {
+        OPENSSL_sk_free(stacks[n]);
+    }
+    free(stacks);
+    return 0;
+}